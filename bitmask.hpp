@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace custom_json {
+
+// Bit-parallel helpers shared by the scanning kernels. Each 64-bit mask
+// describes one 64-byte block of input, bit i standing for byte i.
+
+// Returns the mask of characters escaped by a preceding backslash. A run of
+// backslashes escapes the character after it only when the run has odd
+// length, so `\"` ends nothing but `\\"` closes the string.
+// `prev_escaped` carries a run that reaches the end of the block into the
+// next one; start it at zero.
+inline uint64_t escaped_characters(uint64_t backslash, uint64_t& prev_escaped) {
+    constexpr uint64_t even_bits = 0x5555555555555555ULL;
+    backslash &= ~prev_escaped;
+    const uint64_t follows_escape = (backslash << 1) | prev_escaped;
+    // Runs that start on an odd bit: adding them to the backslash mask carries
+    // through each run and lands just past its end, flipping the parity.
+    const uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits;
+    prev_escaped = __builtin_add_overflow(odd_sequence_starts, backslash, &sequences_starting_on_even_bits) ? 1 : 0;
+    const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+} // namespace custom_json
@@ -0,0 +1,57 @@
+#include "cpu.hpp"
+#include <cpuid.h>
+#include <cstdint>
+
+namespace custom_json {
+
+static uint64_t read_xcr0() {
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+
+static SimdLevel detect_simd_level() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return SimdLevel::Scalar;
+
+    const bool sse2 = edx & bit_SSE2;
+    const bool pclmul = ecx & bit_PCLMUL;
+    const bool avx = ecx & bit_AVX;
+    const bool osxsave = ecx & bit_OSXSAVE;
+
+    // XCR0 bits 1-2 are SSE/AVX state, bits 5-7 the AVX-512 mask and ZMM state.
+    const uint64_t xcr0 = osxsave ? read_xcr0() : 0;
+    const bool ymm_enabled = (xcr0 & 0x06) == 0x06;
+    const bool zmm_enabled = (xcr0 & 0xE6) == 0xE6;
+
+    bool avx2 = false, bmi2 = false, avx512f = false, avx512bw = false;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        avx2 = ebx & bit_AVX2;
+        bmi2 = ebx & bit_BMI2;
+        avx512f = ebx & bit_AVX512F;
+        avx512bw = ebx & bit_AVX512BW;
+    }
+
+    const bool has_avx2 = avx && avx2 && pclmul && ymm_enabled;
+    if (has_avx2 && avx512f && avx512bw && bmi2 && zmm_enabled) return SimdLevel::AVX512;
+    if (has_avx2) return SimdLevel::AVX2;
+    if (sse2) return SimdLevel::SSE2;
+    return SimdLevel::Scalar;
+}
+
+SimdLevel detected_simd_level() {
+    static const SimdLevel level = detect_simd_level();
+    return level;
+}
+
+const char* to_string(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+} // namespace custom_json
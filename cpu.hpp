@@ -0,0 +1,24 @@
+#pragma once
+
+namespace custom_json {
+
+// Instruction-set tiers the hot kernels are compiled for, narrowest first.
+// Each tier assumes everything below it.
+//   SSE2   - 128-bit kernels (baseline on x86-64)
+//   AVX2   - 256-bit kernels, plus PCLMULQDQ for stage 1
+//   AVX512 - 512-bit kernels (AVX-512F/BW, BMI2)
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// The widest tier the running CPU and operating system support. Detected
+// once with CPUID and XGETBV; the latter catches kernels that have not
+// enabled the wider register state even though the CPU has it.
+SimdLevel detected_simd_level();
+
+const char* to_string(SimdLevel level);
+
+} // namespace custom_json
@@ -0,0 +1,428 @@
+#include "document.hpp"
+#include "stage2.hpp"
+#include <algorithm>
+#include <limits>
+#include <string>
+
+namespace custom_json {
+
+static constexpr uint64_t kMaxCount = (uint64_t(1) << 24) - 1;
+
+static constexpr uint64_t make_word(char tag, uint64_t payload) {
+    return (static_cast<uint64_t>(static_cast<uint8_t>(tag)) << 56) | payload;
+}
+
+// Keys are short and looked up once per member, so they are hashed a word
+// at a time rather than with std::hash. Every byte of the key goes into the
+// hash: keys that differ only in the middle (`settings_<n>_override`) must
+// not share a slot, or each one would probe past all the others.
+static constexpr uint64_t kKeyMultiplier = 0x9E3779B97F4A7C15ULL;
+
+// The full 128-bit product folded to 64 bits, as in wyhash: every bit of
+// either operand reaches the low (slot) bits.
+static uint64_t fold_multiply(uint64_t a, uint64_t b) {
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+uint64_t Document::KeyTable::hash(std::string_view key) {
+    const char* p = key.data();
+    const char* end = p + key.size();
+    uint64_t h = 0xC2B2AE3D27D4EB4FULL ^ key.size();
+    if (key.size() >= 8) {
+        // Each 8-byte word in turn; the last one overlaps the one before
+        // unless the length is a multiple of 8.
+        uint64_t word;
+        for (; end - p > 8; p += 8) {
+            std::memcpy(&word, p, 8);
+            h = fold_multiply(h ^ word, kKeyMultiplier);
+        }
+        std::memcpy(&word, end - 8, 8);
+        h = fold_multiply(h ^ word, kKeyMultiplier);
+    } else if (key.size() >= 4) {
+        uint32_t a, b;
+        std::memcpy(&a, p, 4);
+        std::memcpy(&b, end - 4, 4);
+        h = fold_multiply(h ^ (uint64_t(a) << 32 | b), kKeyMultiplier);
+    } else if (p != end) {
+        const std::size_t n = key.size();
+        h = fold_multiply(h ^ (static_cast<uint8_t>(p[0]) | static_cast<uint8_t>(p[n / 2]) << 8 |
+                               static_cast<uint8_t>(p[n - 1]) << 16), kKeyMultiplier);
+    }
+    return fold_multiply(h, kKeyMultiplier);
+}
+
+std::size_t Document::KeyTable::find(const Document& doc, std::string_view key, uint64_t hash,
+                                     std::size_t& probes) const {
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+        ++probes;
+        const Slot& slot = slots_[i];
+        if (slot.first == 0) return npos;
+        if (slot.hash == hash && doc.string_at(slot.first - 1) == key) return slot.first - 1;
+    }
+}
+
+void Document::KeyTable::add(std::size_t index, uint64_t hash) {
+    if ((size_ + 1) * 2 > slots_.size()) {  // keep the load under a half
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        for (const Slot& slot : old) {
+            if (slot.first != 0) insert(slot);
+        }
+    }
+    insert({hash, index + 1});
+    ++size_;
+}
+
+void Document::KeyTable::insert(const Slot& slot) {
+    const std::size_t mask = slots_.size() - 1;
+    std::size_t i = slot.hash & mask;
+    while (slots_[i].first != 0) i = (i + 1) & mask;
+    slots_[i] = slot;
+}
+
+// Appends one word per token to the tape. A container's start word is
+// written when it closes, once its end and element count are known.
+class TapeBuilder {
+public:
+    // `input_size` is used to size the buffers up front: typical documents
+    // need about one tape word per 12 input bytes, and string contents make
+    // up less than half the input. If `input` is given, strings without
+    // escapes are left in it and only escaped ones are copied. If `writable`
+    // is given too (the same buffer), escaped strings are decoded in place
+    // and every string is NUL-terminated.
+    TapeBuilder(Document& doc, std::size_t input_size, const char* input = nullptr, char* writable = nullptr)
+        : doc_(doc), tape_(doc.tape_), strings_(doc.strings_), input_(input), writable_(writable) {
+        doc.input_ = input;
+        tape_.reserve(input_size / 8 + 4);
+        if (!input) strings_.reserve(input_size / 2 + 16);
+    }
+
+    void null_value() { count_element(); tape_.push_back(make_word('n', 0)); }
+    void bool_value(bool b) { count_element(); tape_.push_back(make_word(b ? 't' : 'f', 0)); }
+
+    void number_value(const Number& num) {
+        count_element();
+        switch (num.kind) {
+            case Number::Kind::Int64:
+                tape_.push_back(make_word('l', 0));
+                tape_.push_back(static_cast<uint64_t>(num.i));
+                break;
+            case Number::Kind::UInt64:
+                tape_.push_back(make_word('u', 0));
+                tape_.push_back(num.u);
+                break;
+            case Number::Kind::Double:
+                tape_.push_back(make_word('d', 0));
+                tape_.push_back(std::bit_cast<uint64_t>(num.d));
+                break;
+        }
+    }
+
+    bool string_value(const RawString& s) { count_element(); return append_string(s); }
+
+    // Keys are interned: every occurrence of a key after the first reuses
+    // the first one's word, so its bytes are stored once and keys can be
+    // compared by word (see Document::key()).
+    bool key(const RawString& s) {
+        ++open_.back().count;
+        const std::size_t at = tape_.size();
+        if (!s.escaped) {
+            const std::string_view name(s.begin, s.size());
+            const uint64_t hash = Document::KeyTable::hash(name);
+            const std::size_t first = doc_.keys_.find(doc_, name, hash, doc_.key_probes_);
+            if (first != Document::KeyTable::npos) return reuse_key(first, name.size());
+            if (!append_string(s)) return false;
+            doc_.keys_.add(at, hash);
+            return true;
+        }
+        const std::size_t strings_at = strings_.size();
+        if (!append_string(s)) return false;
+        const std::string_view name = doc_.string_at(at);
+        const uint64_t hash = Document::KeyTable::hash(name);
+        const std::size_t first = doc_.keys_.find(doc_, name, hash, doc_.key_probes_);
+        if (first != Document::KeyTable::npos) {
+            tape_.resize(at);
+            strings_.resize(strings_at);
+            return reuse_key(first, name.size());
+        }
+        doc_.keys_.add(at, hash);
+        return true;
+    }
+
+    void start_array() { open_container(false); }
+    void end_array() { close_container('[', ']'); }
+    void start_object() { open_container(true); }
+    void end_object() { close_container('{', '}'); }
+
+private:
+    struct Frame {
+        std::size_t start;
+        uint64_t count;
+        bool object;  // members are counted by their keys
+    };
+
+    void count_element() {
+        if (!open_.empty() && !open_.back().object) ++open_.back().count;
+    }
+
+    void open_container(bool object) {
+        count_element();
+        open_.push_back({tape_.size(), 0, object});
+        tape_.push_back(0);  // filled in by close_container()
+    }
+
+    void close_container(char open_tag, char close_tag) {
+        const Frame frame = open_.back();
+        open_.pop_back();
+        tape_.push_back(make_word(close_tag, frame.start));
+        tape_[frame.start] = make_word(open_tag, (std::min(frame.count, kMaxCount) << 32) | tape_.size());
+    }
+
+    bool append_string(const RawString& s) {
+        if (writable_) {
+            // Decoded text is never longer than its source, so it fits where
+            // the source was, and the NUL fits where the closing quote was.
+            char* out = writable_ + (s.begin - input_);
+            char* out_end = s.escaped ? kernels::decode_string(s.begin, s.end, out) : out + s.size();
+            if (!out_end) return false;
+            *out_end = '\0';
+            tape_.push_back(make_word('s', static_cast<uint64_t>(s.begin - input_)));
+            tape_.push_back(static_cast<uint64_t>(out_end - out));
+            return true;
+        }
+        if (input_ && !s.escaped) {
+            tape_.push_back(make_word('s', static_cast<uint64_t>(s.begin - input_)));
+            tape_.push_back(s.size());
+            return true;
+        }
+        const std::size_t at = strings_.size();
+        strings_.resize(at + sizeof(uint32_t) + s.size() + 1);
+        char* out = strings_.data() + at + sizeof(uint32_t);
+        char* out_end = decode_raw_string(s, out);
+        if (!out_end) return false;
+        const uint32_t length = static_cast<uint32_t>(out_end - out);
+        std::memcpy(strings_.data() + at, &length, sizeof(length));
+        *out_end = '\0';
+        strings_.resize(at + sizeof(uint32_t) + length + 1);
+        tape_.push_back(make_word('"', at));
+        return true;
+    }
+
+    bool reuse_key(std::size_t first, std::size_t length) {
+        const uint64_t word = tape_[first];
+        tape_.push_back(word);
+        if (word >> 56 == 's') tape_.push_back(length);
+        return true;
+    }
+
+    Document& doc_;
+    std::vector<uint64_t>& tape_;
+    std::vector<char>& strings_;
+    const char* input_;
+    char* writable_;
+    std::vector<Frame> open_;
+};
+
+int64_t Element::as_int64() const {
+    switch (tag()) {
+        case 'l': return static_cast<int64_t>(tape_[index_ + 1]);
+        case 'u': return Value(tape_[index_ + 1]).as_int64();
+        case 'd': return Value(as_number()).as_int64();
+        default: throw std::runtime_error("Element is not a number");
+    }
+}
+
+uint64_t Element::as_uint64() const {
+    switch (tag()) {
+        case 'l': return Value(static_cast<int64_t>(tape_[index_ + 1])).as_uint64();
+        case 'u': return tape_[index_ + 1];
+        case 'd': return Value(as_number()).as_uint64();
+        default: throw std::runtime_error("Element is not a number");
+    }
+}
+
+std::size_t Element::count() const {
+    const uint64_t stored = (payload() >> 32) & kMaxCount;
+    if (stored < kMaxCount) return static_cast<std::size_t>(stored);
+    std::size_t n = 0;  // Saturated: count by walking
+    if (tag() == '[') {
+        for (auto it = ArrayView(*this).begin(), end = ArrayView(*this).end(); it != end; ++it) ++n;
+    } else {
+        for (auto it = ObjectView(*this).begin(), end = ObjectView(*this).end(); it != end; ++it) ++n;
+    }
+    return n;
+}
+
+std::optional<Element> Element::find(Key key) const {
+    as_object();  // throws if this is not an object
+    std::optional<Element> found;
+    for (std::size_t member = index_ + 1, end = next() - 1; member < end;) {
+        const Element value = at(at(member).next());
+        if (tape_[member] == key.word_) found = value;
+        member = value.next();
+    }
+    return found;
+}
+
+Element Element::operator[](Key key) const {
+    if (std::optional<Element> value = find(key)) return *value;
+    throw std::out_of_range("No member with the given key");
+}
+
+std::optional<Key> Document::key(std::string_view name) const {
+    std::size_t probes = 0;
+    const std::size_t first = keys_.find(*this, name, KeyTable::hash(name), probes);
+    if (first == KeyTable::npos) return std::nullopt;
+    return Key(tape_[first]);
+}
+
+std::string_view Document::string_at(std::size_t index) const {
+    return Element(tape_.data(), strings_.data(), input_, index).as_string();
+}
+
+std::optional<Element> Element::find(std::string_view key) const {
+    std::optional<Element> found;
+    for (const Member& member : as_object()) {
+        if (member.key == key) found = member.value;
+    }
+    return found;
+}
+
+Element Element::operator[](std::string_view key) const {
+    if (std::optional<Element> value = find(key)) return *value;
+    throw std::out_of_range("No member named " + std::string(key));
+}
+
+Element Element::operator[](std::size_t index) const {
+    for (Element element : as_array()) {
+        if (index-- == 0) return element;
+    }
+    throw std::out_of_range("Array index out of range");
+}
+
+Value Element::to_value() const {
+    switch (tag()) {
+        case 'n': return Value();
+        case 't': return Value(true);
+        case 'f': return Value(false);
+        case 'l': return Value(static_cast<int64_t>(tape_[index_ + 1]));
+        case 'u': return Value(tape_[index_ + 1]);
+        case 'd': return Value(as_number());
+        case '"': case 's': return Value(as_string());
+        case '[': {
+            Value::Array arr;
+            arr.reserve(count());
+            for (Element element : as_array()) arr.push_back(element.to_value());
+            return Value(std::move(arr));
+        }
+        default: {
+            Value::Object obj;
+            obj.reserve(count());
+            for (const Member& member : as_object()) obj.insert_or_assign(member.key, member.value.to_value());
+            return Value(std::move(obj));
+        }
+    }
+}
+
+static void write_value(TapeBuilder& builder, const Value& value) {
+    const auto raw = [](std::string_view s) { return RawString{s.data(), s.data() + s.size(), false}; };
+    switch (value.type()) {
+        case Value::Type::Null: builder.null_value(); break;
+        case Value::Type::Boolean: builder.bool_value(value.as_bool()); break;
+        case Value::Type::String: builder.string_value(raw(value.as_string())); break;
+        case Value::Type::Number: {
+            Number num;
+            if (!value.is_integer()) {
+                num.kind = Number::Kind::Double;
+                num.d = value.as_number();
+            } else if (value.as_number() < 0) {
+                num.kind = Number::Kind::Int64;
+                num.i = value.as_int64();
+            } else {
+                num.kind = Number::Kind::UInt64;
+                num.u = value.as_uint64();
+                if (num.u <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+                    num.kind = Number::Kind::Int64;  // as the parser would have stored it
+                    num.i = static_cast<int64_t>(num.u);
+                }
+            }
+            builder.number_value(num);
+            break;
+        }
+        case Value::Type::Array:
+            builder.start_array();
+            if (const auto doubles = value.as_double_span()) {
+                for (double d : *doubles) write_value(builder, Value(d));
+            } else if (const auto integers = value.as_int64_span()) {
+                for (int64_t i : *integers) write_value(builder, Value(i));
+            } else {
+                for (const Value& element : value.as_array()) write_value(builder, element);
+            }
+            builder.end_array();
+            break;
+        case Value::Type::Object:
+            builder.start_object();
+            for (const auto& [key, member] : value.as_object()) {
+                builder.key(raw(key));
+                write_value(builder, member);
+            }
+            builder.end_object();
+            break;
+    }
+}
+
+Document Document::from_value(const Value& value) {
+    Document doc;
+    TapeBuilder builder(doc, 0);
+    write_value(builder, value);
+    return doc;
+}
+
+std::expected<Document, ParseError> try_parse_document(std::string_view json, const ParseOptions& options) {
+    Document doc;
+    TapeBuilder builder(doc, json.size());
+    if (auto parsed = run_parser(json, options, builder); !parsed) {
+        return std::unexpected(parsed.error());
+    }
+    return doc;
+}
+
+Document parse_document(const std::string& json, const ParseOptions& options) {
+    std::expected<Document, ParseError> result = try_parse_document(json, options);
+    if (!result) throw_parse_error(result.error(), json);
+    return std::move(*result);
+}
+
+std::expected<Document, ParseError> try_parse_document_view(std::string_view json, const ParseOptions& options) {
+    Document doc;
+    TapeBuilder builder(doc, json.size(), json.data());
+    if (auto parsed = run_parser(json, options, builder); !parsed) {
+        return std::unexpected(parsed.error());
+    }
+    return doc;
+}
+
+Document parse_document_view(std::string_view json, const ParseOptions& options) {
+    std::expected<Document, ParseError> result = try_parse_document_view(json, options);
+    if (!result) throw_parse_error(result.error(), json);
+    return std::move(*result);
+}
+
+std::expected<Document, ParseError> try_parse_insitu(std::span<char> json, const ParseOptions& options) {
+    Document doc;
+    TapeBuilder builder(doc, json.size(), json.data(), json.data());
+    if (auto parsed = run_parser(std::string_view(json.data(), json.size()), options, builder); !parsed) {
+        return std::unexpected(parsed.error());
+    }
+    return doc;
+}
+
+Document parse_insitu(std::span<char> json, const ParseOptions& options) {
+    std::expected<Document, ParseError> result = try_parse_insitu(json, options);
+    if (!result) throw_parse_error(result.error(), std::string_view(json.data(), json.size()));
+    return std::move(*result);
+}
+
+} // namespace custom_json
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "json_parser.hpp"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace custom_json {
+
+class Element;
+class Key;
+
+// A parsed document stored as a flat tape of 64-bit words plus one buffer of
+// string contents, rather than a tree of separately allocated nodes. Each
+// word has a tag in its top byte and a payload in the low 56 bits:
+//
+//   'n' 't' 'f'  null, true, false
+//   'l' 'u' 'd'  int64, uint64, double; the value is the following word
+//   '"'          a string; the payload is its offset in the string buffer,
+//                which holds a 32-bit length, the bytes and a NUL
+//   's'          a string read straight from the input; the payload is its
+//                offset there and the following word its length
+//   '[' '{'      start of an array or object; bits 0-31 are the index just
+//                past the matching end word, bits 32-55 the number of
+//                elements or members (saturating at 2^24 - 1)
+//   ']' '}'      end of an array or object; the payload is the start's index
+//
+// An object member is its key's string word followed by the value. Only
+// documents parsed with try_parse_document_view() or try_parse_insitu() have
+// 's' words.
+class Document {
+public:
+    // The top-level value. Elements point into the tape and string buffer,
+    // so they stay valid while the Document lives, even if it is moved.
+    Element root() const;
+
+    // Builds the tape for an existing tree; Element::to_value() goes the
+    // other way.
+    static Document from_value(const Value& value);
+
+    // Keys are interned while parsing: every occurrence of a key shares
+    // one tape word, and so one copy of its bytes. key() looks that word up
+    // in the document's hash table of distinct keys.
+    std::optional<Key> key(std::string_view name) const;
+
+    std::size_t tape_size() const { return tape_.size(); }
+    std::size_t string_buffer_size() const { return strings_.size(); }
+
+private:
+    friend class TapeBuilder;
+    friend struct DocumentTestAccess;  // defined by the tests
+
+    // The distinct keys: an open-addressing table of the tape index of each
+    // key's first occurrence.
+    class KeyTable {
+    public:
+        static constexpr std::size_t npos = std::size_t(-1);
+
+        static uint64_t hash(std::string_view key);
+
+        // The tape index of `key` in `doc`, or npos. Adds the number of
+        // slots examined to `probes`.
+        std::size_t find(const Document& doc, std::string_view key, uint64_t hash, std::size_t& probes) const;
+
+        // `index` must be a key not in the table yet.
+        void add(std::size_t index, uint64_t hash);
+
+        std::size_t size() const { return size_; }
+        std::size_t slots() const { return slots_.size(); }
+
+    private:
+        struct Slot {
+            uint64_t hash;
+            std::size_t first;  // tape index + 1, or 0 if the slot is empty
+        };
+
+        void insert(const Slot& slot);
+
+        std::vector<Slot> slots_ = std::vector<Slot>(16);
+        std::size_t size_ = 0;
+    };
+
+    // The string or key whose word is at `index`.
+    std::string_view string_at(std::size_t index) const;
+
+    std::vector<uint64_t> tape_;
+    std::vector<char> strings_;
+    KeyTable keys_;
+    std::size_t key_probes_ = 0;  // slots examined while interning
+    const char* input_ = nullptr;  // for 's' words; not owned
+};
+
+// An interned key of one Document. Member lookup with a Key compares a
+// single tape word per member instead of the key's bytes. Using it with any
+// other document gives meaningless results.
+class Key {
+private:
+    friend class Document;
+    friend class Element;
+    explicit Key(uint64_t word) : word_(word) {}
+    uint64_t word_;
+};
+
+// A member of an object, as produced by iterating an ObjectView.
+struct Member;
+class ArrayView;
+class ObjectView;
+
+// A lightweight view of one value in a Document. The accessors mirror
+// Value's; on a type mismatch they throw std::runtime_error.
+class Element {
+public:
+    Value::Type type() const {
+        switch (tag()) {
+            case 'n': return Value::Type::Null;
+            case 't': case 'f': return Value::Type::Boolean;
+            case '"': case 's': return Value::Type::String;
+            case '[': return Value::Type::Array;
+            case '{': return Value::Type::Object;
+            default: return Value::Type::Number;
+        }
+    }
+
+    bool is_null() const { return tag() == 'n'; }
+    bool is_integer() const { return tag() == 'l' || tag() == 'u'; }
+
+    bool as_bool() const {
+        if (tag() != 't' && tag() != 'f') throw std::runtime_error("Element is not a boolean");
+        return tag() == 't';
+    }
+
+    // Converts integers to the nearest double.
+    double as_number() const {
+        switch (tag()) {
+            case 'l': return static_cast<double>(static_cast<int64_t>(tape_[index_ + 1]));
+            case 'u': return static_cast<double>(tape_[index_ + 1]);
+            case 'd': return std::bit_cast<double>(tape_[index_ + 1]);
+            default: throw std::runtime_error("Element is not a number");
+        }
+    }
+
+    // Same conversions as Value::as_int64() and Value::as_uint64().
+    int64_t as_int64() const;
+    uint64_t as_uint64() const;
+
+    std::string_view as_string() const {
+        if (tag() == 's') return {input_ + payload(), static_cast<std::size_t>(tape_[index_ + 1])};
+        if (tag() != '"') throw std::runtime_error("Element is not a string");
+        const char* at = strings_ + payload();
+        uint32_t length;
+        std::memcpy(&length, at, sizeof(length));
+        return {at + sizeof(length), length};
+    }
+
+    ArrayView as_array() const;
+    ObjectView as_object() const;
+
+    // Member lookup. As in a Value, the last member with the key wins, so
+    // every member is compared. Throws std::out_of_range if there is none.
+    Element operator[](std::string_view key) const;
+    std::optional<Element> find(std::string_view key) const;
+
+    // As above, comparing interned keys; see Document::key().
+    Element operator[](Key key) const;
+    std::optional<Element> find(Key key) const;
+
+    // Array indexing; walks past the elements before `index`.
+    Element operator[](std::size_t index) const;
+
+    // Copies this value and everything under it into a tree.
+    Value to_value() const;
+
+private:
+    friend class Document;
+    friend class ArrayView;
+    friend class ObjectView;
+
+    Element(const uint64_t* tape, const char* strings, const char* input, std::size_t index)
+        : tape_(tape), strings_(strings), input_(input), index_(index) {}
+
+    // Another value in the same document.
+    Element at(std::size_t index) const { return Element(tape_, strings_, input_, index); }
+
+    char tag() const { return static_cast<char>(tape_[index_] >> 56); }
+    uint64_t payload() const { return tape_[index_] & ((uint64_t(1) << 56) - 1); }
+
+    // The index of the word after this value.
+    std::size_t next() const {
+        switch (tag()) {
+            case '[': case '{': return static_cast<uint32_t>(payload());
+            case 'l': case 'u': case 'd': case 's': return index_ + 2;
+            default: return index_ + 1;
+        }
+    }
+
+    std::size_t count() const;
+
+    const uint64_t* tape_;
+    const char* strings_;
+    const char* input_;
+    std::size_t index_;
+};
+
+struct Member {
+    std::string_view key;
+    Element value;
+};
+
+class ArrayView {
+public:
+    class iterator {
+    public:
+        using value_type = Element;
+        using difference_type = std::ptrdiff_t;
+
+        Element operator*() const { return current_; }
+        iterator& operator++() { current_.index_ = current_.next(); return *this; }
+        iterator operator++(int) { iterator old = *this; ++*this; return old; }
+        bool operator==(const iterator& other) const { return current_.index_ == other.current_.index_; }
+
+    private:
+        friend class ArrayView;
+        explicit iterator(Element current) : current_(current) {}
+        Element current_;
+    };
+
+    iterator begin() const { return iterator(array_.at(array_.index_ + 1)); }
+    iterator end() const { return iterator(array_.at(array_.next() - 1)); }
+    std::size_t size() const { return array_.count(); }
+    bool empty() const { return array_.next() == array_.index_ + 2; }
+
+private:
+    friend class Element;
+    explicit ArrayView(Element array) : array_(array) {}
+    Element array_;
+};
+
+class ObjectView {
+public:
+    class iterator {
+    public:
+        using value_type = Member;
+        using difference_type = std::ptrdiff_t;
+
+        Member operator*() const {
+            return {key_.as_string(), key_.at(key_.next())};
+        }
+        iterator& operator++() { key_.index_ = key_.at(key_.next()).next(); return *this; }
+        iterator operator++(int) { iterator old = *this; ++*this; return old; }
+        bool operator==(const iterator& other) const { return key_.index_ == other.key_.index_; }
+
+    private:
+        friend class ObjectView;
+        explicit iterator(Element key) : key_(key) {}
+        Element key_;
+    };
+
+    iterator begin() const { return iterator(object_.at(object_.index_ + 1)); }
+    iterator end() const { return iterator(object_.at(object_.next() - 1)); }
+    std::size_t size() const { return object_.count(); }
+    bool empty() const { return object_.next() == object_.index_ + 2; }
+
+private:
+    friend class Element;
+    explicit ObjectView(Element object) : object_(object) {}
+    Element object_;
+};
+
+inline Element Document::root() const {
+    return Element(tape_.data(), strings_.data(), input_, 0);
+}
+
+inline ArrayView Element::as_array() const {
+    if (tag() != '[') throw std::runtime_error("Element is not an array");
+    return ArrayView(*this);
+}
+
+inline ObjectView Element::as_object() const {
+    if (tag() != '{') throw std::runtime_error("Element is not an object");
+    return ObjectView(*this);
+}
+
+// Parses into a Document; errors are reported as by try_parse().
+std::expected<Document, ParseError> try_parse_document(std::string_view json, const ParseOptions& options = {});
+
+// As try_parse_document(), but throws std::runtime_error.
+Document parse_document(const std::string& json, const ParseOptions& options = {});
+
+// As try_parse_document(), but strings without escapes are not copied: their
+// elements refer to the bytes of `json`, which must outlive the Document and
+// every string_view taken from it. Only escaped strings are decoded into the
+// document's own buffer.
+std::expected<Document, ParseError> try_parse_document_view(std::string_view json, const ParseOptions& options = {});
+
+// As try_parse_document_view(), but throws std::runtime_error.
+Document parse_document_view(std::string_view json, const ParseOptions& options = {});
+
+// Destructive parsing: escaped strings are decoded in place in `json` and
+// every string and key is NUL-terminated, so all of them are views into the
+// caller's buffer and nothing is copied. The buffer must outlive the
+// Document. Whatever the outcome, its contents are no longer the original
+// JSON; after an error, the reported line may count newlines decoded from
+// earlier strings.
+std::expected<Document, ParseError> try_parse_insitu(std::span<char> json, const ParseOptions& options = {});
+
+// As try_parse_insitu(), but throws std::runtime_error.
+Document parse_insitu(std::span<char> json, const ParseOptions& options = {});
+
+} // namespace custom_json
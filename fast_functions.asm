@@ -1,22 +1,189 @@
+; Hand-written kernels used by the parser. Each one has a scalar reference
+; in kernels.cpp that the tests compare it against, and a microbenchmark in
+; kernel_bench.cpp. System V AMD64 calling convention throughout.
+;
+; The *_avx2 kernels are only reached through the dispatch table in
+; kernels.cpp, which installs them when the CPU supports AVX2. The others
+; use nothing beyond baseline x86-64 (SSE2).
+
+default rel
+
+section .rodata
+align 32
+space_bytes:     times 32 db 0x20
+tab_bytes:       times 32 db 0x09
+lf_bytes:        times 32 db 0x0A
+cr_bytes:        times 32 db 0x0D
+quote_bytes:     times 32 db 0x22
+backslash_bytes: times 32 db 0x5C
+control_bytes:   times 32 db 0x1F
+
 section .text
-global fast_strcmp
+global json_skip_whitespace_avx2
+global json_find_quote_or_backslash_avx2
+global json_match_literal
+global json_memcmp_bounded
 
-fast_strcmp:
-    mov     al, [rdi]
-    cmp     al, [rsi]
-    jne     .not_equal
-    test    al, al
-    jz      .equal
-    inc     rdi
-    inc     rsi
-    jmp     fast_strcmp
+; const char* json_skip_whitespace_avx2(const char* p, const char* end)
+; Returns the first byte in [p, end) that is not space, tab, LF or CR, or end.
+json_skip_whitespace_avx2:
+    mov     rax, rdi
+.vector_loop:
+    mov     rcx, rsi
+    sub     rcx, rax
+    cmp     rcx, 32
+    jb      .tail
+    vmovdqu ymm0, [rax]
+    vpcmpeqb ymm1, ymm0, [space_bytes]
+    vpcmpeqb ymm2, ymm0, [tab_bytes]
+    vpor    ymm1, ymm1, ymm2
+    vpcmpeqb ymm2, ymm0, [lf_bytes]
+    vpor    ymm1, ymm1, ymm2
+    vpcmpeqb ymm2, ymm0, [cr_bytes]
+    vpor    ymm1, ymm1, ymm2
+    vpmovmskb ecx, ymm1
+    not     ecx
+    test    ecx, ecx
+    jnz     .found
+    add     rax, 32
+    jmp     .vector_loop
+.found:
+    bsf     ecx, ecx
+    add     rax, rcx
+    vzeroupper
+    ret
+.tail:
+    vzeroupper
+.tail_loop:
+    cmp     rax, rsi
+    jae     .done
+    movzx   ecx, byte [rax]
+    cmp     cl, 0x20
+    je      .next
+    cmp     cl, 0x09
+    je      .next
+    cmp     cl, 0x0A
+    je      .next
+    cmp     cl, 0x0D
+    jne     .done
+.next:
+    inc     rax
+    jmp     .tail_loop
+.done:
+    ret
+
+; const char* json_find_quote_or_backslash_avx2(const char* p, const char* end)
+; Returns the first '"', '\' or control character (< 0x20) in [p, end), or end.
+json_find_quote_or_backslash_avx2:
+    mov     rax, rdi
+.vector_loop:
+    mov     rcx, rsi
+    sub     rcx, rax
+    cmp     rcx, 32
+    jb      .tail
+    vmovdqu ymm0, [rax]
+    vpcmpeqb ymm1, ymm0, [quote_bytes]
+    vpcmpeqb ymm2, ymm0, [backslash_bytes]
+    vpor    ymm1, ymm1, ymm2
+    vpmaxub ymm2, ymm0, [control_bytes]     ; max(c, 0x1F) == 0x1F  <=>  c <= 0x1F
+    vpcmpeqb ymm2, ymm2, [control_bytes]
+    vpor    ymm1, ymm1, ymm2
+    vpmovmskb ecx, ymm1
+    test    ecx, ecx
+    jnz     .found
+    add     rax, 32
+    jmp     .vector_loop
+.found:
+    bsf     ecx, ecx
+    add     rax, rcx
+    vzeroupper
+    ret
+.tail:
+    vzeroupper
+.tail_loop:
+    cmp     rax, rsi
+    jae     .done
+    movzx   ecx, byte [rax]
+    cmp     cl, 0x22
+    je      .done
+    cmp     cl, 0x5C
+    je      .done
+    cmp     cl, 0x20
+    jb      .done
+    inc     rax
+    jmp     .tail_loop
+.done:
+    ret
 
-.not_equal:
+; int json_match_literal(const char* p, const char* end)
+; Returns 1 for "true", 2 for "false", 3 for "null" at p and 0 otherwise,
+; reading only bytes in [p, end). The words are compared four bytes at once.
+json_match_literal:
+    mov     rcx, rsi
+    sub     rcx, rdi
+    cmp     rcx, 4
+    jl      .none
+    mov     eax, [rdi]
+    cmp     eax, 0x65757274         ; "true"
+    je      .true
+    cmp     eax, 0x6C6C756E         ; "null"
+    je      .null
+    cmp     eax, 0x736C6166         ; "fals"
+    jne     .none
+    cmp     rcx, 5
+    jl      .none
+    cmp     byte [rdi + 4], 0x65    ; "e"
+    jne     .none
+    mov     eax, 2
+    ret
+.true:
+    mov     eax, 1
+    ret
+.null:
+    mov     eax, 3
+    ret
+.none:
+    xor     eax, eax
+    ret
+
+; int json_memcmp_bounded(const void* a, const void* b, size_t n)
+; Compares exactly n bytes, 16 at a time, and returns <0, 0 or >0 like
+; memcmp. Never reads past a + n or b + n.
+json_memcmp_bounded:
+.vector_loop:
+    cmp     rdx, 16
+    jb      .tail
+    movdqu  xmm0, [rdi]
+    movdqu  xmm1, [rsi]
+    pcmpeqb xmm0, xmm1
+    pmovmskb eax, xmm0
+    xor     eax, 0xFFFF
+    jnz     .differ
+    add     rdi, 16
+    add     rsi, 16
+    sub     rdx, 16
+    jmp     .vector_loop
+.differ:
+    bsf     eax, eax
+    movzx   ecx, byte [rsi + rax]
+    movzx   eax, byte [rdi + rax]
+    sub     eax, ecx
+    ret
+.tail:
+    test    rdx, rdx
+    jz      .equal
+.tail_loop:
     movzx   eax, byte [rdi]
     movzx   ecx, byte [rsi]
     sub     eax, ecx
-    ret
-
+    jnz     .done
+    inc     rdi
+    inc     rsi
+    dec     rdx
+    jnz     .tail_loop
 .equal:
     xor     eax, eax
+.done:
     ret
+
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -1,172 +1,437 @@
 #include "json_parser.hpp"
-#include <cstring>
-#include <cstdlib>
-#include <cctype>
-#include <iostream>
-#include <immintrin.h>
-
-extern "C" int fast_strcmp(const char* s1, const char* s2);
+#include "stage2.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <bit>
 
 namespace custom_json {
 
-static Value parse_array(const char*& start, const char* end);
-static Value parse_object(const char*& start, const char* end);
+// Builds a Value in place: each token is written straight into the slot its
+// parent has made for it, so nothing is copied or moved once built.
+class ValueBuilder {
+public:
+    // An open container. Its elements are not touched while it is open, so
+    // pointers to the containers further down the stack stay valid. When
+    // packing, an array has neither container until it holds something
+    // other than numbers of one kind, which are kept in Scratch::numbers.
+    struct Frame {
+        Value* value;
+        Value::Array* array;
+        Value::Object* object;
+        Number::Kind kind;  // of the numbers held back, if any
+    };
 
-static const char* skip_whitespace(const char*& start, const char* end) {
-    // Skip all whitespace characters, including newlines, spaces, tabs, etc.
-    while (start < end && (isspace(*start) || *start == '\n' || *start == '\r' || *start == '\t')) {
-        ++start;
-    }
-    return start;
-}
+    // Working memory that a Parser keeps from one document to the next.
+    struct Scratch {
+        std::vector<Frame> stack;
+        std::string decoded_key;        // holds the current key if it had escapes
+        std::vector<uint64_t> numbers;  // the open array's numbers, while it may still be packed
+    };
 
-static Value parse_string(const char*& start, const char* end) {
-    ++start; // Skip opening quote
-    const char* str_end = start;
-    while (str_end < end) {
-        if (*str_end == '"' && *(str_end - 1) != '\\') break;
-        ++str_end;
+    // Arrays, objects and strings are allocated from `resource`.
+    ValueBuilder(Value& root, std::pmr::memory_resource* resource, Scratch& scratch, bool pack_numeric_arrays)
+        : root_(root), resource_(resource), stack_(scratch.stack), decoded_key_(scratch.decoded_key),
+          numbers_(scratch.numbers), pack_(pack_numeric_arrays) {
+        stack_.clear();  // left over if the last parse failed
+        numbers_.clear();
     }
-    if (str_end < end) {
-        Value result(std::string(start, str_end));
-        start = str_end + 1; // Skip closing quote
-        return result;
+
+    void null_value() { slot() = Value(); }
+    void bool_value(bool b) { slot() = Value(b); }
+
+    void number_value(const Number& num) {
+        if (hold_number(num)) return;
+        switch (num.kind) {
+            case Number::Kind::Int64: slot() = Value(num.i); break;
+            case Number::Kind::UInt64: slot() = Value(num.u); break;
+            case Number::Kind::Double: slot() = Value(num.d); break;
+        }
     }
-    throw std::runtime_error("Unterminated string");
-}
 
-static Value parse_number(const char*& start, const char* end) {
-    char* num_end;
-    double num = std::strtod(start, &num_end);
-    if (num_end > start) {
-        start = num_end;
-        return Value(num);
+    bool string_value(const RawString& s) {
+        Value& value = slot();
+        char* end = decode_raw_string(s, value.prepare_string(s.size(), resource_));
+        if (!end) return false;  // the parse fails and the tree is discarded
+        value.finish_string(end);
+        return true;
     }
-    throw std::runtime_error("Invalid number: " + std::string(start, end - start));
-}
 
-static Value parse_value(const char*& start, const char* end) {
-    start = skip_whitespace(start, end);  // Ensure we skip any leading whitespace
+    // Unescaped keys are used straight from the input; the object copies
+    // the key only if it has no member by that name yet.
+    bool key(const RawString& s) {
+        if (!s.escaped) {
+            key_ = {s.begin, s.size()};
+            return true;
+        }
+        decoded_key_.resize(s.size());
+        char* end = decode_raw_string(s, decoded_key_.data());
+        if (!end) return false;
+        key_ = {decoded_key_.data(), static_cast<std::size_t>(end - decoded_key_.data())};
+        return true;
+    }
 
-    if (start >= end) {
-        throw std::runtime_error("Unexpected end of JSON");
+    void start_array() {
+        Value& value = slot();
+        if (pack_) stack_.push_back({&value, nullptr, nullptr, Number::Kind::Int64});
+        else stack_.push_back({&value, &value.make_array(resource_), nullptr, Number::Kind::Int64});
     }
 
-    switch (*start) {
-        case 'n':  // Parse `null`
-            if (end - start >= 4 && strncmp(start, "null", 4) == 0) {
-                start += 4;
-                return Value();  // Return null
+    void end_array() {
+        const Frame& top = stack_.back();
+        if (!top.array) {
+            if (numbers_.empty()) {
+                top.value->make_array(resource_);
+            } else {
+                const Value::Tag tag = top.kind == Number::Kind::Double ? Value::Tag::DoubleArray : Value::Tag::Int64Array;
+                top.value->make_number_array(tag, numbers_, resource_);
+                numbers_.clear();
             }
-            break;
-        case 't':  // Parse `true`
-            if (end - start >= 4 && strncmp(start, "true", 4) == 0) {
-                start += 4;
-                return Value(true);  // Return boolean true
+        }
+        stack_.pop_back();
+    }
+
+    void start_object() {
+        Value& value = slot();
+        stack_.push_back({&value, nullptr, &value.make_object(resource_), Number::Kind::Int64});
+    }
+    void end_object() { stack_.pop_back(); }
+
+private:
+    Value& slot() {
+        if (stack_.empty()) return root_;
+        Frame& top = stack_.back();
+        if (top.object) return (*top.object)[key_];
+        if (!top.array) unpack(top);
+        return top.array->emplace_back();
+    }
+
+    // Keeps `num` back if the open array may still be packed.
+    bool hold_number(const Number& num) {
+        if (stack_.empty()) return false;
+        Frame& top = stack_.back();
+        if (top.array || top.object || num.kind == Number::Kind::UInt64) return false;
+        if (!numbers_.empty() && num.kind != top.kind) return false;
+        top.kind = num.kind;
+        numbers_.push_back(num.kind == Number::Kind::Double ? std::bit_cast<uint64_t>(num.d) : static_cast<uint64_t>(num.i));
+        return true;
+    }
+
+    // The open array turns out not to be packable: gives it a generic
+    // container holding the numbers seen so far.
+    void unpack(Frame& top) {
+        top.array = &top.value->make_array(resource_);
+        top.array->reserve(numbers_.size() + 1);
+        for (uint64_t bits : numbers_) {
+            if (top.kind == Number::Kind::Double) top.array->emplace_back(std::bit_cast<double>(bits));
+            else top.array->emplace_back(static_cast<int64_t>(bits));
+        }
+        numbers_.clear();
+    }
+
+    Value& root_;
+    std::pmr::memory_resource* resource_;
+    std::vector<Frame>& stack_;
+    std::string_view key_;  // the key of the member about to be parsed
+    std::string& decoded_key_;
+    std::vector<uint64_t>& numbers_;
+    bool pack_;
+};
+
+// A bump allocator over blocks that are kept when it is rewound. A parse
+// that outgrows the first block adds more; the next rewind merges them into
+// one block of their total size, so the arena settles at one block big
+// enough for the documents it sees.
+class ReusableArena : public std::pmr::memory_resource {
+public:
+    explicit ReusableArena(std::pmr::memory_resource* upstream) : upstream_(upstream) {}
+    ReusableArena(const ReusableArena&) = delete;
+    ReusableArena& operator=(const ReusableArena&) = delete;
+    ~ReusableArena() override {
+        for (const Block& block : blocks_) upstream_->deallocate(block.data, block.size, alignof(std::max_align_t));
+    }
+
+    // Forgets everything allocated since the last rewind. No destructors run.
+    void rewind() {
+        if (blocks_.size() > 1) {
+            std::size_t total = 0;
+            for (const Block& block : blocks_) {
+                total += block.size;
+                upstream_->deallocate(block.data, block.size, alignof(std::max_align_t));
             }
-            break;
-        case 'f':  // Parse `false`
-            if (end - start >= 5 && strncmp(start, "false", 5) == 0) {
-                start += 5;
-                return Value(false);  // Return boolean false
+            blocks_.clear();
+            add_block(total);
+        }
+        current_ = 0;
+        used_ = 0;
+    }
+
+private:
+    struct Block {
+        void* data;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t kMinBlockSize = 4096;
+
+    void add_block(std::size_t size) {
+        blocks_.push_back({upstream_->allocate(size, alignof(std::max_align_t)), size});
+    }
+
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        while (true) {
+            if (current_ < blocks_.size()) {
+                void* p = static_cast<char*>(blocks_[current_].data) + used_;
+                std::size_t space = blocks_[current_].size - used_;
+                if (std::align(alignment, size, p, space)) {
+                    used_ = blocks_[current_].size - space + size;
+                    return p;
+                }
+                if (current_ + 1 < blocks_.size()) {
+                    ++current_;
+                    used_ = 0;
+                    continue;
+                }
             }
-            break;
-        case '"':  // Parse string
-            return parse_string(start, end);
-        case '[':  // Parse array
-            return parse_array(start, end);
-        case '{':  // Parse object
-            return parse_object(start, end);
-        case '-':  // Parse number (negative)
-        case '0': case '1': case '2': case '3': case '4':
-        case '5': case '6': case '7': case '8': case '9':  // Parse number
-            return parse_number(start, end);
-        default:
-            throw std::runtime_error("Unrecognized JSON value");
+            const std::size_t last = blocks_.empty() ? kMinBlockSize / 2 : blocks_.back().size;
+            add_block(std::max(2 * last, size + alignment));
+            current_ = blocks_.size() - 1;
+            used_ = 0;
+        }
     }
 
-    throw std::runtime_error("Unrecognized JSON value");
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::pmr::memory_resource* upstream_;
+    std::vector<Block> blocks_;
+    std::size_t current_ = 0;  // the block being bumped through
+    std::size_t used_ = 0;     // bytes taken from it
+};
+
+struct Parser::State {
+    explicit State(std::pmr::memory_resource* upstream) : arena(upstream) {}
+
+    StructuralIndex index;
+    ReusableArena arena;
+    ValueBuilder::Scratch scratch;
+};
+
+char* Value::prepare_string(std::size_t size, std::pmr::memory_resource* resource) {
+    if (tag() >= Tag::LongString) release();
+    if (size <= kShortStringCapacity) {
+        bytes_[15] = static_cast<unsigned char>(Tag::ShortString);
+        return reinterpret_cast<char*>(bytes_);
+    }
+    void* memory = resource->allocate(sizeof(LongString) + size, alignof(LongString));
+    LongString* block = new (memory) LongString{resource, size, size};
+    store(Tag::LongString, block);
+    return block->data();
 }
 
-static Value parse_array(const char*& start, const char* end) {
-    Value::Array arr;
-    ++start; // Skip opening bracket
-    start = skip_whitespace(start, end);
-    
-    if (*start != ']') {
-        do {
-            arr.push_back(parse_value(start, end));
-            start = skip_whitespace(start, end);
-        } while (*start == ',' && (++start, true));
-        
-        if (*start != ']') throw std::runtime_error("Expected ']' in array");
+void Value::finish_string(char* end) {
+    if (tag() == Tag::ShortString) {
+        bytes_[kShortStringCapacity] = static_cast<unsigned char>(end - reinterpret_cast<char*>(bytes_));
+    } else {
+        LongString* block = load<LongString*>();
+        block->size = static_cast<std::size_t>(end - block->data());
     }
-    
-    ++start; // Skip closing bracket
-    return Value(std::move(arr));
 }
 
-static Value parse_object(const char*& start, const char* end) {
-    Value::Object obj;
-    ++start;  // Skip the opening brace '{'
-    start = skip_whitespace(start, end);
+Value::Array& Value::make_array(std::pmr::memory_resource* resource) {
+    if (tag() >= Tag::LongString) release();
+    Array* array = std::pmr::polymorphic_allocator<Array>(resource).new_object<Array>();
+    store(Tag::Array, array);
+    return *array;
+}
 
-    if (*start != '}') {  // If the object is not immediately closed
-        do {
-            // Skip any leading whitespace before parsing the key
-            start = skip_whitespace(start, end);
+Value::Object& Value::make_object(std::pmr::memory_resource* resource) {
+    if (tag() >= Tag::LongString) release();
+    Object* object = std::pmr::polymorphic_allocator<Object>(resource).new_object<Object>();
+    store(Tag::Object, object);
+    return *object;
+}
 
-            // If the first non-whitespace character is not a double-quote, throw an error
-            if (*start != '"') {
-                std::cerr << "Error: Expected string as key in object, but found '" << *start << "' instead." << std::endl;
-                throw std::runtime_error("Expected string as key in object");
-            }
+void Value::make_number_array(Tag tag, std::span<const uint64_t> bits, std::pmr::memory_resource* resource) {
+    if (this->tag() >= Tag::LongString) release();
+    void* memory = resource->allocate(sizeof(NumberArray) + bits.size_bytes(), alignof(NumberArray));
+    NumberArray* block = new (memory) NumberArray{resource, bits.size(), nullptr};
+    std::memcpy(block->data(), bits.data(), bits.size_bytes());
+    store(tag, block);
+}
 
-            // Parse the string key
-            std::string key = parse_string(start, end).as_string();
-            //std::cout << "Parsed key: " << key << std::endl;  // Debugging: log the parsed key
+// Two threads may both get here for the same array: the first to publish
+// its expansion wins and the other's is dropped.
+const Value::Array& Value::expand_number_array() const {
+    NumberArray* block = load<NumberArray*>();
+    if (Array* expanded = block->expanded.load(std::memory_order_acquire)) return *expanded;
+    std::pmr::polymorphic_allocator<Array> alloc(block->resource);
+    Array* array = alloc.new_object<Array>();
+    array->reserve(block->size);
+    if (tag() == Tag::DoubleArray) {
+        for (double d : number_span<double>()) array->emplace_back(d);
+    } else {
+        for (int64_t i : number_span<int64_t>()) array->emplace_back(i);
+    }
+    Array* expected = nullptr;
+    if (block->expanded.compare_exchange_strong(expected, array, std::memory_order_acq_rel)) return *array;
+    alloc.delete_object(array);
+    return *expected;
+}
 
-            // Skip whitespace after the key
-            start = skip_whitespace(start, end);
+void Value::copy_from(const Value& other) {
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+    switch (other.tag()) {
+        case Tag::LongString: {
+            const std::string_view s = other.as_string();
+            finish_string(std::copy(s.begin(), s.end(), prepare_string(s.size(), resource)));
+            break;
+        }
+        case Tag::Array: make_array(resource) = other.as_array(); break;
+        case Tag::Object: make_object(resource) = other.as_object(); break;
+        case Tag::DoubleArray:
+        case Tag::Int64Array: {
+            const std::span<const int64_t> numbers = other.number_span<int64_t>();
+            make_number_array(other.tag(), {reinterpret_cast<const uint64_t*>(numbers.data()), numbers.size()}, resource);
+            break;
+        }
+        default: std::memcpy(bytes_, other.bytes_, sizeof(bytes_)); break;
+    }
+}
 
-            // Ensure the colon ':' follows the key
-            if (*start != ':') {
-                std::cerr << "Error: Expected ':' after key in object, but found '" << *start << "' instead." << std::endl;
-                throw std::runtime_error("Expected ':' after key in object");
+// Each block goes back to the resource it came from, which arrays and
+// objects remember in their allocator and long strings and packed arrays in
+// their header.
+void Value::release() {
+    switch (tag()) {
+        case Tag::LongString: {
+            LongString* block = load<LongString*>();
+            block->resource->deallocate(block, sizeof(LongString) + block->capacity, alignof(LongString));
+            break;
+        }
+        case Tag::Array: {
+            Array* array = load<Array*>();
+            std::pmr::polymorphic_allocator<Array>(array->get_allocator()).delete_object(array);
+            break;
+        }
+        case Tag::Object: {
+            Object* object = load<Object*>();
+            std::pmr::polymorphic_allocator<Object>(object->get_allocator()).delete_object(object);
+            break;
+        }
+        case Tag::DoubleArray:
+        case Tag::Int64Array: {
+            NumberArray* block = load<NumberArray*>();
+            if (Array* expanded = block->expanded.load(std::memory_order_acquire)) {
+                std::pmr::polymorphic_allocator<Array>(expanded->get_allocator()).delete_object(expanded);
             }
+            block->resource->deallocate(block, sizeof(NumberArray) + block->size * sizeof(uint64_t), alignof(NumberArray));
+            break;
+        }
+        default:
+            break;
+    }
+    store(Tag::Null, uint64_t(0));
+}
 
-            ++start;  // Skip the colon
-            start = skip_whitespace(start, end);  // Skip whitespace after the colon
+void Value::type_error(const char* message) {
+    throw TypeError(message);
+}
 
-            // Parse the associated value
-            obj[key] = parse_value(start, end);
+ParseError::Location ParseError::location(std::string_view json) const {
+    const std::string_view before = json.substr(0, offset);
+    const std::size_t line_start = before.rfind('\n');
+    return {
+        static_cast<std::size_t>(std::count(before.begin(), before.end(), '\n')) + 1,
+        line_start == std::string_view::npos ? before.size() + 1 : before.size() - line_start,
+    };
+}
 
-            // Skip any trailing whitespace and check for a comma or closing brace
-            start = skip_whitespace(start, end);
-        } while (*start == ',' && (++start, true));  // Move to the next key-value pair if a comma is present
+const char* to_string(ParseErrorCode code) {
+    switch (code) {
+        case ParseErrorCode::UnexpectedEnd: return "Unexpected end of JSON";
+        case ParseErrorCode::UnrecognizedValue: return "Unrecognized JSON value";
+        case ParseErrorCode::InvalidNumber: return "Invalid number";
+        case ParseErrorCode::UnterminatedString: return "Unterminated string";
+        case ParseErrorCode::InvalidEscape: return "Invalid escape sequence in string";
+        case ParseErrorCode::ControlCharacterInString: return "Unescaped control character in string";
+        case ParseErrorCode::InvalidUtf8: return "Invalid UTF-8";
+        case ParseErrorCode::ExpectedKey: return "Expected string as key in object";
+        case ParseErrorCode::ExpectedColon: return "Expected ':' after key in object";
+        case ParseErrorCode::ExpectedArrayEnd: return "Expected ']' in array";
+        case ParseErrorCode::ExpectedObjectEnd: return "Expected '}' at the end of object";
+        case ParseErrorCode::TrailingCharacters: return "Unexpected trailing characters";
+        case ParseErrorCode::DocumentTooLarge: return "Document too large for structural index";
+    }
+    return "Unknown error";
+}
 
-        // Ensure the object is properly closed
-        if (*start != '}') {
-            std::cerr << "Error: Expected '}' at the end of object, but found '" << *start << "' instead." << std::endl;
-            throw std::runtime_error("Expected '}' at the end of object");
-        }
+bool Value::KeyEqual::equal_bytes(const char* a, const char* b, std::size_t size) noexcept {
+    return kernels::memcmp_bounded(a, b, size) == 0;
+}
+
+std::expected<Value, ParseError> try_parse(std::string_view json, const ParseOptions& options) {
+    Value root;
+    ValueBuilder::Scratch scratch;
+    ValueBuilder builder(root, std::pmr::get_default_resource(), scratch, options.pack_numeric_arrays);
+    if (auto parsed = run_parser(json, options, builder); !parsed) {
+        return std::unexpected(parsed.error());
     }
+    return root;
+}
 
-    ++start;  // Skip the closing brace '}'
-    return Value(std::move(obj));  // Return the parsed object
+std::expected<ArenaDocument, ParseError> try_parse_arena(std::string_view json, const ParseOptions& options) {
+    // Parsed trees take roughly twice the input's size; starting the arena
+    // there means one or two upstream allocations for most documents.
+    ArenaDocument doc;
+    doc.arena_ = std::make_unique<std::pmr::monotonic_buffer_resource>(2 * json.size() + 256);
+    doc.root_ = std::pmr::polymorphic_allocator<Value>(doc.arena_.get()).new_object<Value>();
+    ValueBuilder::Scratch scratch;
+    ValueBuilder builder(*doc.root_, doc.arena_.get(), scratch, options.pack_numeric_arrays);
+    if (auto parsed = run_parser(json, options, builder); !parsed) {
+        return std::unexpected(parsed.error());
+    }
+    return doc;
+}
+
+void throw_parse_error(const ParseError& error, std::string_view json) {
+    const ParseError::Location where = error.location(json);
+    throw std::runtime_error(std::string("JSON parse error: ") + to_string(error.code) + " at line " +
+                             std::to_string(where.line) + ", column " + std::to_string(where.column));
+}
+
+Value parse(const std::string& json_string, const ParseOptions& options) {
+    std::expected<Value, ParseError> result = try_parse(json_string, options);
+    if (!result) throw_parse_error(result.error(), json_string);
+    return std::move(*result);
 }
 
-Value parse(const std::string& json_string) {
-    const char* start = json_string.c_str();
-    const char* end = start + json_string.length();
-    try {
-        Value result = parse_value(start, end);
-        start = skip_whitespace(start, end);
-        if (start != end) throw std::runtime_error("Unexpected trailing characters");
-        return result;
-    } catch (const std::exception& e) {
-        throw std::runtime_error(std::string("JSON parse error: ") + e.what());
+ArenaDocument parse_arena(const std::string& json_string, const ParseOptions& options) {
+    std::expected<ArenaDocument, ParseError> result = try_parse_arena(json_string, options);
+    if (!result) throw_parse_error(result.error(), json_string);
+    return std::move(*result);
+}
+
+Parser::Parser(std::pmr::memory_resource* upstream) : state_(std::make_unique<State>(upstream)) {}
+Parser::~Parser() = default;
+Parser::Parser(Parser&&) noexcept = default;
+Parser& Parser::operator=(Parser&&) noexcept = default;
+
+std::expected<const Value*, ParseError> Parser::try_parse(std::string_view json, const ParseOptions& options) {
+    // The last tree is abandoned with the arena, like an ArenaDocument's.
+    state_->arena.rewind();
+    Value* root = std::pmr::polymorphic_allocator<Value>(&state_->arena).new_object<Value>();
+    ValueBuilder builder(*root, &state_->arena, state_->scratch, options.pack_numeric_arrays);
+    if (auto parsed = run_parser(json, options, builder, state_->index); !parsed) {
+        return std::unexpected(parsed.error());
     }
+    return root;
+}
+
+const Value& Parser::parse(std::string_view json, const ParseOptions& options) {
+    std::expected<const Value*, ParseError> result = try_parse(json, options);
+    if (!result) throw_parse_error(result.error(), json);
+    return **result;
 }
 
 } // namespace custom_json
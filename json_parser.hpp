@@ -1,18 +1,207 @@
 #pragma once
 
+#include "parse_error.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 #include <stdexcept>
-#include <variant>
 #include <optional>
+#include <variant>
 
 namespace custom_json {
 
+// A JSON value in 16 bytes: a tag plus either a scalar, a short string held
+// inline, or a pointer. Long strings, arrays and objects are allocated
+// through std::pmr, so a whole tree can live in one arena (see
+// ArenaDocument). Trees built any other way, and copies of arena trees, use
+// the default heap resource.
 class Value {
 public:
-    using Array = std::vector<Value>;
-    using Object = std::unordered_map<std::string, Value>;
+    // Keys can be looked up by any string type without building a KeyString.
+    struct KeyHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const noexcept {
+            return std::hash<std::string_view>{}(key);
+        }
+    };
+
+    // Compares object keys with the SIMD memcmp kernel.
+    struct KeyEqual {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const noexcept {
+            return a.size() == b.size() && equal_bytes(a.data(), b.data(), a.size());
+        }
+        static bool equal_bytes(const char* a, const char* b, std::size_t size) noexcept;
+    };
+
+    using Array = std::pmr::vector<Value>;
+
+    // An object key in 24 bytes. Keys of up to kInlineCapacity bytes, which
+    // is nearly all of them, are stored inline; longer ones are copied to a
+    // block from the object's memory resource. Converts to std::string_view.
+    class KeyString {
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        static constexpr std::size_t kInlineCapacity = 23;
+
+        KeyString(std::string_view s, const allocator_type& alloc = {}) { assign(s, alloc.resource()); }
+        KeyString(const KeyString& other, const allocator_type& alloc = {}) : KeyString(other.view(), alloc) {}
+        KeyString(KeyString&& other) noexcept { steal(other); }
+        KeyString(KeyString&& other, const allocator_type& alloc) {
+            if (other.spilled() && other.load().resource != alloc.resource()) assign(other.view(), alloc.resource());
+            else steal(other);
+        }
+
+        // A spilled key keeps its resource; an inline one has none, so a
+        // long key assigned to it goes to the default resource.
+        KeyString& operator=(const KeyString& other) {
+            if (this != &other) *this = KeyString(other.view(), get_allocator());
+            return *this;
+        }
+        KeyString& operator=(KeyString&& other) noexcept {
+            if (this != &other) {
+                release();
+                steal(other);
+            }
+            return *this;
+        }
+
+        ~KeyString() { release(); }
+
+        std::string_view view() const {
+            if (!spilled()) return {reinterpret_cast<const char*>(bytes_), bytes_[kInlineCapacity]};
+            const Spilled spill = load();
+            return {spill.data, spill.size};
+        }
+        operator std::string_view() const { return view(); }
+        const char* data() const { return view().data(); }
+        std::size_t size() const { return view().size(); }
+        friend bool operator==(const KeyString& a, std::string_view b) { return a.view() == b; }
+
+        allocator_type get_allocator() const {
+            return spilled() ? load().resource : std::pmr::get_default_resource();
+        }
+
+    private:
+        static constexpr unsigned char kSpilled = 0xFF;  // in the last byte
+
+        struct Spilled {
+            char* data;
+            std::pmr::memory_resource* resource;
+            uint32_t size;
+        };
+
+        bool spilled() const { return bytes_[kInlineCapacity] == kSpilled; }
+
+        Spilled load() const {
+            Spilled spill;
+            std::memcpy(&spill, bytes_, sizeof(spill));
+            return spill;
+        }
+
+        void assign(std::string_view s, std::pmr::memory_resource* resource) {
+            if (s.size() <= kInlineCapacity) {
+                std::memcpy(bytes_, s.data(), s.size());
+                bytes_[kInlineCapacity] = static_cast<unsigned char>(s.size());
+                return;
+            }
+            if (s.size() > UINT32_MAX) throw std::length_error("Object key is too long");
+            const Spilled spill{static_cast<char*>(resource->allocate(s.size(), 1)), resource, static_cast<uint32_t>(s.size())};
+            std::memcpy(spill.data, s.data(), s.size());
+            std::memcpy(bytes_, &spill, sizeof(spill));
+            bytes_[kInlineCapacity] = kSpilled;
+        }
+
+        void steal(KeyString& other) {
+            std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+            other.bytes_[kInlineCapacity] = 0;
+        }
+
+        void release() {
+            if (!spilled()) return;
+            const Spilled spill = load();
+            spill.resource->deallocate(spill.data, spill.size, 1);
+            bytes_[kInlineCapacity] = 0;
+        }
+
+        // Inline: the characters, then the length in byte 23. Spilled: a
+        // Spilled, and kSpilled in byte 23.
+        alignas(8) unsigned char bytes_[24] = {};
+    };
+
+    // An object's members in source order, stored contiguously. Small
+    // objects are searched linearly; once an object has kIndexThreshold
+    // members a hash index over its keys is built, and kept up to date as
+    // members are added. Keys are unique: adding one that is already present
+    // replaces its value where it stands.
+    class Object {
+    public:
+        using value_type = std::pair<KeyString, Value>;
+        using allocator_type = std::pmr::polymorphic_allocator<value_type>;
+        using const_iterator = const value_type*;
+        using iterator = const_iterator;
+
+        static constexpr std::size_t kIndexThreshold = 16;
+
+        Object(allocator_type alloc = {}) : members_(alloc), index_(alloc) {}
+
+        const_iterator begin() const { return members_.data(); }
+        const_iterator end() const { return members_.data() + members_.size(); }
+        std::size_t size() const { return members_.size(); }
+        bool empty() const { return members_.empty(); }
+
+        const_iterator find(std::string_view key) const { return begin() + position(key); }
+        bool contains(std::string_view key) const { return position(key) != size(); }
+
+        // Throws std::out_of_range if there is no member named `key`.
+        const Value& at(std::string_view key) const {
+            const std::size_t at = position(key);
+            if (at == size()) throw std::out_of_range("No member named " + std::string(key));
+            return members_[at].second;
+        }
+
+        // The value for `key`, added as null if it is not present yet.
+        Value& operator[](std::string_view key) {
+            const std::size_t at = position(key);
+            return at != size() ? members_[at].second : append(key);
+        }
+
+        void insert_or_assign(std::string_view key, Value&& value) { (*this)[key] = std::move(value); }
+        void reserve(std::size_t n) { members_.reserve(n); }
+        allocator_type get_allocator() const { return members_.get_allocator(); }
+
+    private:
+        // The member's position, or size() if there is none.
+        std::size_t position(std::string_view key) const;
+
+        Value& append(std::string_view key);
+        void add_to_index(std::size_t member);
+        void rebuild_index(std::size_t slots);
+
+        std::pmr::vector<value_type> members_;
+        std::pmr::vector<uint32_t> index_;  // open addressing; member position + 1, or 0 if empty
+    };
+
+    // Thrown by the accessors on a type mismatch. It derives from
+    // std::bad_variant_access, which they threw when Value was a variant.
+    class TypeError : public std::bad_variant_access {
+    public:
+        explicit TypeError(const char* message) noexcept : message_(message) {}
+        const char* what() const noexcept override { return message_; }
+
+    private:
+        const char* message_;  // a string literal
+    };
 
     enum class Type {
         Null,
@@ -24,46 +213,333 @@ public:
     };
 
 private:
-    std::variant<std::monostate, bool, double, std::string, Array, Object> data;
+    friend class ValueBuilder;
+
+    // What the 16 bytes hold. Integers are kept exactly; all three numeric
+    // tags report Type::Number, both string tags Type::String and all three
+    // array tags Type::Array.
+    enum class Tag : uint8_t {
+        Null,
+        Boolean,
+        Double,
+        Int64,
+        UInt64,
+        ShortString,  // up to kShortStringCapacity bytes, stored inline
+        LongString,   // the rest own a block from a memory resource
+        Array,
+        Object,
+        DoubleArray,  // packed numeric arrays; see as_double_span()
+        Int64Array
+    };
+
+    static constexpr std::size_t kShortStringCapacity = 14;
+
+    // A long string's bytes follow this header in the same block.
+    struct LongString {
+        std::pmr::memory_resource* resource;
+        std::size_t size;
+        std::size_t capacity;
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    // A packed array's numbers follow this header in the same block. The
+    // generic form is built the first time as_array() is called, from the
+    // same resource, and kept.
+    struct NumberArray {
+        std::pmr::memory_resource* resource;
+        std::size_t size;
+        std::atomic<Array*> expanded;
+        unsigned char* data() { return reinterpret_cast<unsigned char*>(this + 1); }
+    };
+
+    // Bytes 0-7 hold a scalar or a pointer, or together with bytes 8-13 the
+    // characters of a short string. Byte 14 is a short string's length and
+    // byte 15 the tag.
+    alignas(8) unsigned char bytes_[16] = {};
+
+    Tag tag() const { return static_cast<Tag>(bytes_[15]); }
+
+    template<typename T>
+    T load() const {
+        T v;
+        std::memcpy(&v, bytes_, sizeof(T));
+        return v;
+    }
+
+    template<typename T>
+    void store(Tag tag, T v) {
+        std::memcpy(bytes_, &v, sizeof(T));
+        bytes_[15] = static_cast<unsigned char>(tag);
+    }
+
+    // The builder writes strings in place: a buffer of at least `size`
+    // bytes, then the size actually used, which may be smaller.
+    char* prepare_string(std::size_t size, std::pmr::memory_resource* resource);
+    void finish_string(char* end);
+
+    Array& make_array(std::pmr::memory_resource* resource);
+    Object& make_object(std::pmr::memory_resource* resource);
+
+    // `tag` is DoubleArray or Int64Array and `bits` the numbers' bit patterns.
+    void make_number_array(Tag tag, std::span<const uint64_t> bits, std::pmr::memory_resource* resource);
+    const Array& expand_number_array() const;
+
+    template<typename T>
+    std::span<const T> number_span() const {
+        NumberArray* block = load<NumberArray*>();
+        return {reinterpret_cast<const T*>(block->data()), block->size};
+    }
+
+    void copy_from(const Value& other);
+    void release();  // frees whatever a long string, array or object owns
+
+    [[noreturn]] static void type_error(const char* message);
 
 public:
-    Value() : data(std::monostate{}) {}
-    Value(bool b) : data(b) {}
-    Value(double d) : data(d) {}
-    Value(const std::string& s) : data(s) {}
-    Value(const Array& a) : data(a) {}
-    Value(const Object& o) : data(o) {}
+    Value() = default;
+    Value(bool b) { store(Tag::Boolean, b); }
+    Value(double d) { store(Tag::Double, d); }
+    Value(int i) { store(Tag::Int64, int64_t(i)); }
+    Value(int64_t i) { store(Tag::Int64, i); }
+    Value(uint64_t u) { store(Tag::UInt64, u); }
+    Value(const std::string& s) : Value(std::string_view(s)) {}
+    explicit Value(std::string_view s, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+        finish_string(std::copy(s.begin(), s.end(), prepare_string(s.size(), resource)));
+    }
+    Value(const Array& a) { make_array(std::pmr::get_default_resource()) = a; }
+    Value(Array&& a) { make_array(a.get_allocator().resource()) = std::move(a); }
+    Value(const Object& o) { make_object(std::pmr::get_default_resource()) = o; }
+    Value(Object&& o) { make_object(o.get_allocator().resource()) = std::move(o); }
+
+    // Copies use the default resource, as copies of pmr containers do.
+    Value(const Value& other) { copy_from(other); }
+    Value(Value&& other) noexcept {
+        std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+        other.store(Tag::Null, uint64_t(0));
+    }
+
+    Value& operator=(const Value& other) {
+        if (this != &other) *this = Value(other);
+        return *this;
+    }
+
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            if (tag() >= Tag::LongString) release();
+            std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+            other.store(Tag::Null, uint64_t(0));
+        }
+        return *this;
+    }
+
+    ~Value() {
+        if (tag() >= Tag::LongString) release();
+    }
 
     Type type() const {
-        return static_cast<Type>(data.index());
+        switch (tag()) {
+            case Tag::Null: return Type::Null;
+            case Tag::Boolean: return Type::Boolean;
+            case Tag::ShortString: case Tag::LongString: return Type::String;
+            case Tag::Array: case Tag::DoubleArray: case Tag::Int64Array: return Type::Array;
+            case Tag::Object: return Type::Object;
+            default: return Type::Number;
+        }
     }
 
-    template<typename T>
-    const T& get() const {
-        return std::get<T>(data);
+    // True for numbers parsed (or constructed) as integers.
+    bool is_integer() const {
+        return tag() == Tag::Int64 || tag() == Tag::UInt64;
     }
 
-    const std::string& as_string() const {
-        return get<std::string>();
+    // The accessors throw TypeError on a type mismatch.
+    std::string_view as_string() const {
+        if (tag() == Tag::ShortString) return {reinterpret_cast<const char*>(bytes_), bytes_[kShortStringCapacity]};
+        if (tag() != Tag::LongString) type_error("Value is not a string");
+        LongString* block = load<LongString*>();
+        return {block->data(), block->size};
     }
 
+    // Converts integers to the nearest double.
     double as_number() const {
-        return get<double>();
+        switch (tag()) {
+            case Tag::Int64: return static_cast<double>(load<int64_t>());
+            case Tag::UInt64: return static_cast<double>(load<uint64_t>());
+            case Tag::Double: return load<double>();
+            default: type_error("Value is not a number");
+        }
+    }
+
+    // Integer accessors. Throw std::out_of_range if the value does not fit,
+    // or is a double with a fractional part.
+    int64_t as_int64() const {
+        if (tag() == Tag::Int64) return load<int64_t>();
+        if (tag() == Tag::UInt64) {
+            const uint64_t u = load<uint64_t>();
+            if (u <= static_cast<uint64_t>(INT64_MAX)) return static_cast<int64_t>(u);
+            throw std::out_of_range("Number does not fit in int64_t");
+        }
+        const double d = as_number();
+        if (d >= -0x1p63 && d < 0x1p63 && static_cast<double>(static_cast<int64_t>(d)) == d) return static_cast<int64_t>(d);
+        throw std::out_of_range("Number is not an int64_t");
+    }
+
+    uint64_t as_uint64() const {
+        if (tag() == Tag::UInt64) return load<uint64_t>();
+        if (tag() == Tag::Int64) {
+            const int64_t i = load<int64_t>();
+            if (i >= 0) return static_cast<uint64_t>(i);
+            throw std::out_of_range("Number does not fit in uint64_t");
+        }
+        const double d = as_number();
+        if (d >= 0 && d < 0x1p64 && static_cast<double>(static_cast<uint64_t>(d)) == d) return static_cast<uint64_t>(d);
+        throw std::out_of_range("Number is not a uint64_t");
     }
 
     bool as_bool() const {
-        return get<bool>();
+        if (tag() != Tag::Boolean) type_error("Value is not a boolean");
+        return load<bool>();
     }
 
+    // Packed arrays are expanded into Values on first use, so prefer the
+    // span accessors below for them. The expansion comes from the array's
+    // memory resource; in an arena, which is not thread-safe, that makes
+    // the first call on each packed array unsafe to race with others.
     const Array& as_array() const {
-        return get<Array>();
+        if (tag() == Tag::Array) return *load<Array*>();
+        if (tag() != Tag::DoubleArray && tag() != Tag::Int64Array) type_error("Value is not an array");
+        return expand_number_array();
+    }
+
+    // Arrays parsed with ParseOptions::pack_numeric_arrays whose elements
+    // are all doubles, or all integers that fit in int64_t, are stored as
+    // one contiguous buffer of that type. These return it, or nullopt for
+    // any other array; non-arrays throw as as_array() does.
+    std::optional<std::span<const double>> as_double_span() const {
+        if (tag() == Tag::DoubleArray) return number_span<double>();
+        if (type() != Type::Array) type_error("Value is not an array");
+        return std::nullopt;
+    }
+
+    std::optional<std::span<const int64_t>> as_int64_span() const {
+        if (tag() == Tag::Int64Array) return number_span<int64_t>();
+        if (type() != Type::Array) type_error("Value is not an array");
+        return std::nullopt;
     }
 
     const Object& as_object() const {
-        return get<Object>();
+        if (tag() != Tag::Object) type_error("Value is not an object");
+        return *load<Object*>();
     }
 };
 
-Value parse(const std::string& json_string);
+static_assert(sizeof(Value) == 16);
+
+inline std::size_t Value::Object::position(std::string_view key) const {
+    if (index_.empty()) {
+        for (std::size_t i = 0; i < members_.size(); ++i) {
+            if (KeyEqual{}(members_[i].first, key)) return i;
+        }
+        return members_.size();
+    }
+    const std::size_t mask = index_.size() - 1;
+    for (std::size_t slot = KeyHash{}(key) & mask;; slot = (slot + 1) & mask) {
+        const uint32_t entry = index_[slot];
+        if (entry == 0) return members_.size();
+        if (KeyEqual{}(members_[entry - 1].first, key)) return entry - 1;
+    }
+}
+
+inline Value& Value::Object::append(std::string_view key) {
+    if (members_.capacity() == 0) members_.reserve(4);
+    members_.emplace_back(key, Value());  // the key is copied to the object's resource
+    if (!index_.empty()) {
+        if (members_.size() * 2 > index_.size()) rebuild_index(index_.size() * 2);  // keep the load under a half
+        else add_to_index(members_.size() - 1);
+    } else if (members_.size() >= kIndexThreshold) {
+        rebuild_index(4 * kIndexThreshold);
+    }
+    return members_.back().second;
+}
+
+inline void Value::Object::add_to_index(std::size_t member) {
+    const std::size_t mask = index_.size() - 1;
+    std::size_t slot = KeyHash{}(members_[member].first) & mask;
+    while (index_[slot] != 0) slot = (slot + 1) & mask;
+    index_[slot] = static_cast<uint32_t>(member + 1);
+}
+
+inline void Value::Object::rebuild_index(std::size_t slots) {
+    index_.assign(slots, 0);
+    for (std::size_t i = 0; i < members_.size(); ++i) add_to_index(i);
+}
+
+struct ParseOptions {
+    // Reject documents whose strings are not well-formed UTF-8. Large
+    // documents are checked by stage 1 in the same pass that indexes them;
+    // small ones string by string as each is scanned.
+    bool validate_utf8 = false;
+
+    // Store arrays of only doubles, or only int64_t integers, packed in one
+    // buffer (see Value::as_double_span()) instead of one Value per number.
+    // Applies to Value trees; tape documents are unaffected.
+    bool pack_numeric_arrays = false;
+};
+
+// A Value tree whose arrays, objects and strings all live in one arena
+// owned by the document. Destroying it releases the arena in a single step
+// without visiting any node. Values copied out of it are independent;
+// values moved out of it must not outlive it.
+class ArenaDocument {
+public:
+    const Value& root() const { return *root_; }
+
+private:
+    friend std::expected<ArenaDocument, ParseError> try_parse_arena(std::string_view json, const ParseOptions& options);
+
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    Value* root_ = nullptr;  // placed in the arena; its destructor is never run
+};
+
+// Parses a complete document. Malformed input is reported through the
+// returned error rather than by throwing; only allocation failure throws.
+// The tree is allocated from std::pmr::get_default_resource().
+std::expected<Value, ParseError> try_parse(std::string_view json, const ParseOptions& options = {});
+
+// As try_parse(), but throws std::runtime_error naming the error and its
+// line and column.
+Value parse(const std::string& json_string, const ParseOptions& options = {});
+
+// As try_parse(), but builds the tree in an arena owned by the result.
+std::expected<ArenaDocument, ParseError> try_parse_arena(std::string_view json, const ParseOptions& options = {});
+
+// As try_parse_arena(), but throws std::runtime_error.
+ArenaDocument parse_arena(const std::string& json_string, const ParseOptions& options = {});
+
+// Parses one document after another, keeping everything it allocates for
+// the next call: the structural index, the builder's stack and key buffer,
+// and the arena the tree is built in. Once it has seen a document of a
+// given size, parsing another of similar shape allocates nothing.
+// Each tree lives in the parser and is valid until the next parse; copy a
+// Value out of it to keep it longer. The memory is held until the parser
+// is destroyed. A parser is not safe to share between threads.
+class Parser {
+public:
+    // Arena blocks are obtained from `upstream`.
+    explicit Parser(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    ~Parser();
+    Parser(Parser&&) noexcept;
+    Parser& operator=(Parser&&) noexcept;
+
+    // As custom_json::try_parse(), but the result refers to the parser's tree.
+    std::expected<const Value*, ParseError> try_parse(std::string_view json, const ParseOptions& options = {});
+
+    // As try_parse(), but throws std::runtime_error.
+    const Value& parse(std::string_view json, const ParseOptions& options = {});
+
+private:
+    struct State;  // defined in json_parser.cpp
+    std::unique_ptr<State> state_;
+};
 
 } // namespace custom_json
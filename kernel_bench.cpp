@@ -0,0 +1,92 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "kernels.hpp"
+
+// Microbenchmarks for the hand-written kernels in fast_functions.asm, each
+// timed against its scalar reference on call sites taken from real
+// documents: every whitespace run, string body, literal-looking byte and
+// object key in the given directory.
+
+namespace fs = std::filesystem;
+using namespace custom_json::kernels;
+
+static void report(const std::string& name, std::size_t calls, const std::function<void()>& body) {
+    constexpr int rounds = 200;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        body();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> duration = end - start;
+    std::cout << name << ": " << duration.count() / (static_cast<double>(calls) * rounds) << " ns/call" << std::endl;
+}
+
+void benchmark_kernels(const std::string& directory_path) {
+    std::string corpus;
+    for (const auto& entry : fs::directory_iterator(directory_path)) {
+        if (entry.path().extension() == ".json") {
+            std::ifstream file(entry.path());
+            corpus.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+    }
+    const char* begin = corpus.data();
+    const char* end = begin + corpus.size();
+
+    std::vector<const char*> whitespace_runs, string_bodies, literal_starts;
+    std::vector<std::string> keys;
+    bool in_string = false;
+    for (const char* p = begin; p < end; ++p) {
+        if (*p == '"') {
+            if (!in_string) string_bodies.push_back(p + 1);
+            in_string = !in_string;
+        } else if (!in_string && is_whitespace(*p) && (p == begin || !is_whitespace(p[-1]))) {
+            whitespace_runs.push_back(p);
+        } else if (!in_string && (*p == 't' || *p == 'f' || *p == 'n')) {
+            literal_starts.push_back(p);
+        }
+    }
+    for (const char* body : string_bodies) {
+        const char* close = find_quote_or_backslash_scalar(body, end);
+        if (close + 1 < end && close[1] == ':') keys.emplace_back(body, close);
+    }
+
+    std::size_t sink = 0;
+    const auto time_scan = [&](const std::string& name, std::vector<const char*>& sites, auto fn) {
+        report(name, sites.size(), [&] {
+            for (const char* p : sites) sink += static_cast<std::size_t>(fn(p, end) - p);
+        });
+    };
+
+    time_scan("skip_whitespace scalar", whitespace_runs, skip_whitespace_scalar);
+    time_scan("skip_whitespace avx2 (asm)", whitespace_runs, json_skip_whitespace_avx2);
+    time_scan("find_quote_or_backslash scalar", string_bodies, find_quote_or_backslash_scalar);
+    time_scan("find_quote_or_backslash avx2 (asm)", string_bodies, json_find_quote_or_backslash_avx2);
+
+    report("match_literal scalar", literal_starts.size(), [&] {
+        for (const char* p : literal_starts) sink += static_cast<std::size_t>(match_literal_scalar(p, end));
+    });
+    report("match_literal (asm)", literal_starts.size(), [&] {
+        for (const char* p : literal_starts) sink += static_cast<std::size_t>(match_literal(p, end));
+    });
+
+    // Each key against itself (a full-length equal compare) and its neighbour.
+    const auto time_compare = [&](const std::string& name, auto fn) {
+        report(name, keys.size() * 2, [&] {
+            for (std::size_t i = 1; i < keys.size(); ++i) {
+                const std::string& a = keys[i];
+                const std::string& b = keys[i - 1];
+                sink += static_cast<std::size_t>(fn(a.data(), a.data(), a.size()) == 0);
+                sink += static_cast<std::size_t>(fn(a.data(), b.data(), std::min(a.size(), b.size())) == 0);
+            }
+        });
+    };
+    time_compare("memcmp_bounded scalar", memcmp_bounded_scalar);
+    time_compare("memcmp_bounded (asm)", json_memcmp_bounded);
+
+    if (sink == 0) std::cout << std::endl;  // keeps the results observable
+}
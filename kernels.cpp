@@ -0,0 +1,450 @@
+#include "kernels.hpp"
+#include "bitmask.hpp"
+#include "utf8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+namespace custom_json::kernels {
+
+const char* skip_whitespace_scalar(const char* p, const char* end) {
+    while (p < end && is_whitespace(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+__attribute__((target("sse2")))
+const char* skip_whitespace_sse2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+        const unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+        if (other) return p + __builtin_ctz(other);
+        p += 16;
+    }
+    return skip_whitespace_scalar(p, end);
+}
+
+__attribute__((target("avx512f,avx512bw,bmi2")))
+const char* skip_whitespace_avx512(const char* p, const char* end) {
+    while (p < end) {
+        // Masked loads never touch bytes past `end`, so the tail needs no scalar loop.
+        const std::size_t left = static_cast<std::size_t>(end - p);
+        const __mmask64 valid = left >= 64 ? ~__mmask64(0) : _bzhi_u64(~uint64_t(0), static_cast<unsigned>(left));
+        const __m512i chunk = _mm512_maskz_loadu_epi8(valid, p);
+        const __mmask64 ws = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(' ')) |
+                             _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\n')) |
+                             _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\r')) |
+                             _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\t'));
+        const uint64_t other = ~ws & valid;
+        if (other) return p + __builtin_ctzll(other);
+        if (left <= 64) return end;
+        p += 64;
+    }
+    return end;
+}
+
+static bool stops_string_scan(char c) {
+    return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+const char* find_quote_or_backslash_scalar(const char* p, const char* end) {
+    while (p < end && !stops_string_scan(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+__attribute__((target("sse2")))
+const char* find_quote_or_backslash_sse2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i stop = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F)));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(stop));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return find_quote_or_backslash_scalar(p, end);
+}
+
+Literal match_literal_scalar(const char* p, const char* end) {
+    const std::size_t left = static_cast<std::size_t>(end - p);
+    if (left >= 4 && std::memcmp(p, "true", 4) == 0) return Literal::True;
+    if (left >= 4 && std::memcmp(p, "null", 4) == 0) return Literal::Null;
+    if (left >= 5 && std::memcmp(p, "false", 5) == 0) return Literal::False;
+    return Literal::None;
+}
+
+int memcmp_bounded_scalar(const void* a, const void* b, std::size_t n) {
+    const unsigned char* x = static_cast<const unsigned char*>(a);
+    const unsigned char* y = static_cast<const unsigned char*>(b);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (x[i] != y[i]) return x[i] - y[i];
+    }
+    return 0;
+}
+
+// Resolves one 64-byte block of string contents to the mask of bytes that
+// stop the scan, given its quote, backslash and control-character masks.
+static inline uint64_t string_stop_mask(uint64_t quote, uint64_t backslash, uint64_t control, uint64_t& prev_escaped) {
+    return (quote & ~escaped_characters(backslash, prev_escaped)) | control;
+}
+
+const char* find_string_end_scalar(const char* p, const char* end) {
+    bool escaped = false;
+    for (; p < end; ++p) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if (escaped) {
+            escaped = false;
+        } else if (c == '\\') {
+            escaped = true;
+        } else if (c == '"') {
+            return p;
+        }
+        if (c < 0x20) return p;
+    }
+    return end;
+}
+
+// The 16- and 32-byte variants read whole 64-byte blocks; the final partial
+// block is copied into a buffer padded with bytes that stop nothing.
+static const char* pad_block(const char* p, const char* end, char (&buffer)[64]) {
+    std::memset(buffer, 'x', sizeof(buffer));
+    std::memcpy(buffer, p, static_cast<std::size_t>(end - p));
+    return buffer;
+}
+
+__attribute__((target("sse2")))
+const char* find_string_end_sse2(const char* p, const char* end) {
+    uint64_t prev_escaped = 0;
+    char buffer[64];
+    for (; p < end; p += 64) {
+        const char* block = end - p >= 64 ? p : pad_block(p, end, buffer);
+        uint64_t quote = 0, backslash = 0, control = 0;
+        for (int i = 0; i < 4; ++i) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+            const int shift = 16 * i;
+            quote |= uint64_t(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))))) << shift;
+            backslash |= uint64_t(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))))) << shift;
+            control |= uint64_t(static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F))))) << shift;
+        }
+        const uint64_t stop = string_stop_mask(quote, backslash, control, prev_escaped);
+        if (stop) {
+            const char* hit = p + __builtin_ctzll(stop);
+            return hit < end ? hit : end;
+        }
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+const char* find_string_end_avx2(const char* p, const char* end) {
+    uint64_t prev_escaped = 0;
+    char buffer[64];
+    for (; p < end; p += 64) {
+        const char* block = end - p >= 64 ? p : pad_block(p, end, buffer);
+        uint64_t quote = 0, backslash = 0, control = 0;
+        for (int i = 0; i < 2; ++i) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+            const int shift = 32 * i;
+            quote |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'))))) << shift;
+            backslash |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))))) << shift;
+            control |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F))))) << shift;
+        }
+        const uint64_t stop = string_stop_mask(quote, backslash, control, prev_escaped);
+        if (stop) {
+            const char* hit = p + __builtin_ctzll(stop);
+            return hit < end ? hit : end;
+        }
+    }
+    return end;
+}
+
+__attribute__((target("avx512f,avx512bw,bmi2")))
+const char* find_string_end_avx512(const char* p, const char* end) {
+    uint64_t prev_escaped = 0;
+    for (; p < end; p += 64) {
+        const std::size_t left = static_cast<std::size_t>(end - p);
+        const __mmask64 valid = left >= 64 ? ~__mmask64(0) : _bzhi_u64(~uint64_t(0), static_cast<unsigned>(left));
+        const __m512i chunk = _mm512_maskz_loadu_epi8(valid, p);
+        const uint64_t quote = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('"'));
+        const uint64_t backslash = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\\'));
+        const uint64_t control = _mm512_cmple_epu8_mask(chunk, _mm512_set1_epi8(0x1F)) & valid;
+        const uint64_t stop = string_stop_mask(quote, backslash, control, prev_escaped);
+        if (stop) return p + __builtin_ctzll(stop);
+    }
+    return end;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Reads the four hex digits of a \uXXXX escape at p; -1 if malformed.
+static long read_hex4(const char* p, const char* end) {
+    if (end - p < 4) return -1;
+    long code = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int digit = hex_value(p[i]);
+        if (digit < 0) return -1;
+        code = (code << 4) | digit;
+    }
+    return code;
+}
+
+static char* encode_utf8(uint32_t code, char* out) {
+    if (code < 0x80) {
+        *out++ = static_cast<char>(code);
+    } else if (code < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (code >> 6));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (code >> 12));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (code >> 18));
+        *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    return out;
+}
+
+// Decodes the escape sequence whose backslash is at `p`, advancing `p` past
+// it. Returns false if the escape is invalid.
+static bool decode_escape(const char*& p, const char* end, char*& out) {
+    if (end - p < 2) return false;
+    switch (p[1]) {
+        case '"':  *out++ = '"';  break;
+        case '\\': *out++ = '\\'; break;
+        case '/':  *out++ = '/';  break;
+        case 'b':  *out++ = '\b'; break;
+        case 'f':  *out++ = '\f'; break;
+        case 'n':  *out++ = '\n'; break;
+        case 'r':  *out++ = '\r'; break;
+        case 't':  *out++ = '\t'; break;
+        case 'u': {
+            long code = read_hex4(p + 2, end);
+            if (code < 0) return false;
+            p += 6;
+            if (code >= 0xDC00 && code <= 0xDFFF) return false;  // low surrogate on its own
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                // A high surrogate must be followed by an escaped low surrogate.
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u') return false;
+                const long low = read_hex4(p + 2, end);
+                if (low < 0xDC00 || low > 0xDFFF) return false;
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            out = encode_utf8(static_cast<uint32_t>(code), out);
+            return true;
+        }
+        default:
+            return false;
+    }
+    p += 2;
+    return true;
+}
+
+char* decode_string_scalar(const char* p, const char* end, char* out) {
+    while (p < end) {
+        if (*p != '\\') {
+            *out++ = *p++;
+        } else if (!decode_escape(p, end, out)) {
+            return nullptr;
+        }
+    }
+    return out;
+}
+
+// The vector variants copy a whole register at a time while at least that
+// many source bytes remain. Output never runs ahead of input, so decoding in
+// place is safe: a register is only stored whole when it has no backslash,
+// and the run before a backslash is moved on its own, so no store reaches
+// source bytes that have not been read yet.
+__attribute__((target("sse2")))
+char* decode_string_sse2(const char* p, const char* end, char* out) {
+    while (p < end) {
+        if (end - p >= 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const unsigned backslash = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))));
+            if (!backslash) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chunk);
+                p += 16;
+                out += 16;
+                continue;
+            }
+            const int run = __builtin_ctz(backslash);
+            std::memmove(out, p, run);
+            p += run;
+            out += run;
+        } else {
+            while (p < end && *p != '\\') *out++ = *p++;
+            if (p == end) break;
+        }
+        if (!decode_escape(p, end, out)) return nullptr;
+    }
+    return out;
+}
+
+__attribute__((target("avx2")))
+char* decode_string_avx2(const char* p, const char* end, char* out) {
+    while (end - p >= 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const uint32_t backslash = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))));
+        if (!backslash) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chunk);
+            p += 32;
+            out += 32;
+            continue;
+        }
+        const int run = __builtin_ctz(backslash);
+        std::memmove(out, p, run);
+        p += run;
+        out += run;
+        if (!decode_escape(p, end, out)) return nullptr;
+    }
+    return decode_string_sse2(p, end, out);
+}
+
+bool validate_utf8_scalar(const char* p, const char* end) {
+    Utf8ScalarChecker checker;
+    checker.check(p, static_cast<std::size_t>(end - p));
+    return checker.valid();
+}
+
+__attribute__((target("avx2")))
+bool validate_utf8_avx2(const char* p, const char* end) {
+    Utf8Avx2Checker checker;
+    for (; end - p >= 64; p += 64) checker.check_block(p);
+    if (end - p >= 32) {
+        checker.check_half(p);
+        p += 32;
+    }
+    // Most strings are short and ASCII: the tail only goes through the
+    // vector checker (padded with zeros, which are ASCII) if it has to.
+    const std::size_t left = static_cast<std::size_t>(end - p);
+    bool ascii = true;
+    std::size_t i = 0;
+    for (; ascii && i + 8 <= left; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        ascii = (word & 0x8080808080808080ULL) == 0;
+    }
+    for (; ascii && i < left; ++i) ascii = static_cast<unsigned char>(p[i]) < 0x80;
+    if (!ascii) {
+        char buffer[32] = {};
+        std::memcpy(buffer, p, left);
+        checker.check_half(buffer);
+    }
+    return checker.valid();
+}
+
+static std::atomic<SimdLevel> installed_level{SimdLevel::Scalar};
+static std::atomic<bool> installed{false};
+
+static void install(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX512:
+            active.skip_whitespace.store(skip_whitespace_avx512, std::memory_order_relaxed);
+            active.find_quote_or_backslash.store(json_find_quote_or_backslash_avx2, std::memory_order_relaxed);
+            active.find_string_end.store(find_string_end_avx512, std::memory_order_relaxed);
+            active.decode_string.store(decode_string_avx2, std::memory_order_relaxed);
+            active.validate_utf8.store(validate_utf8_avx2, std::memory_order_relaxed);
+            active.index_structurals.store(index_structurals_avx512, std::memory_order_relaxed);
+            break;
+        case SimdLevel::AVX2:
+            active.skip_whitespace.store(json_skip_whitespace_avx2, std::memory_order_relaxed);
+            active.find_quote_or_backslash.store(json_find_quote_or_backslash_avx2, std::memory_order_relaxed);
+            active.find_string_end.store(find_string_end_avx2, std::memory_order_relaxed);
+            active.decode_string.store(decode_string_avx2, std::memory_order_relaxed);
+            active.validate_utf8.store(validate_utf8_avx2, std::memory_order_relaxed);
+            active.index_structurals.store(index_structurals_avx2, std::memory_order_relaxed);
+            break;
+        case SimdLevel::SSE2:
+            active.skip_whitespace.store(skip_whitespace_sse2, std::memory_order_relaxed);
+            active.find_quote_or_backslash.store(find_quote_or_backslash_sse2, std::memory_order_relaxed);
+            active.find_string_end.store(find_string_end_sse2, std::memory_order_relaxed);
+            active.decode_string.store(decode_string_sse2, std::memory_order_relaxed);
+            active.validate_utf8.store(validate_utf8_scalar, std::memory_order_relaxed);
+            active.index_structurals.store(index_structurals_sse2, std::memory_order_relaxed);
+            break;
+        case SimdLevel::Scalar:
+            active.skip_whitespace.store(skip_whitespace_scalar, std::memory_order_relaxed);
+            active.find_quote_or_backslash.store(find_quote_or_backslash_scalar, std::memory_order_relaxed);
+            active.find_string_end.store(find_string_end_scalar, std::memory_order_relaxed);
+            active.decode_string.store(decode_string_scalar, std::memory_order_relaxed);
+            active.validate_utf8.store(validate_utf8_scalar, std::memory_order_relaxed);
+            active.index_structurals.store(index_structurals_scalar, std::memory_order_relaxed);
+            break;
+    }
+    installed_level.store(level, std::memory_order_relaxed);
+    installed.store(true, std::memory_order_relaxed);
+}
+
+SimdLevel use_simd_level(SimdLevel level) {
+    const SimdLevel detected = detected_simd_level();
+    if (level > detected) level = detected;
+    install(level);
+    return level;
+}
+
+SimdLevel active_simd_level() {
+    if (!installed.load(std::memory_order_relaxed)) install(detected_simd_level());
+    return installed_level.load(std::memory_order_relaxed);
+}
+
+// Trampolines the table starts with. Being constant-initialised, the table
+// is safe to use from other translation units' static initialisers.
+static const char* resolve_skip_whitespace(const char* p, const char* end) {
+    install(detected_simd_level());
+    return skip_whitespace(p, end);
+}
+
+static const char* resolve_find_quote_or_backslash(const char* p, const char* end) {
+    install(detected_simd_level());
+    return find_quote_or_backslash(p, end);
+}
+
+static const char* resolve_find_string_end(const char* p, const char* end) {
+    install(detected_simd_level());
+    return find_string_end(p, end);
+}
+
+static char* resolve_decode_string(const char* p, const char* end, char* out) {
+    install(detected_simd_level());
+    return decode_string(p, end, out);
+}
+
+static bool resolve_validate_utf8(const char* p, const char* end) {
+    install(detected_simd_level());
+    return validate_utf8(p, end);
+}
+
+static IndexResult resolve_index_structurals(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    install(detected_simd_level());
+    return index_structurals(data, length, out, validate_utf8);
+}
+
+KernelTable active{
+    {resolve_skip_whitespace},
+    {resolve_find_quote_or_backslash},
+    {resolve_find_string_end},
+    {resolve_decode_string},
+    {resolve_validate_utf8},
+    {resolve_index_structurals},
+};
+
+} // namespace custom_json::kernels
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace custom_json::kernels {
+
+// JSON whitespace is exactly space, tab, line feed and carriage return;
+// unlike isspace() this does not depend on the locale.
+inline bool is_whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Every hot kernel comes in one variant per SimdLevel, compiled with target
+// attributes so the binary itself only assumes baseline x86-64. Calls go
+// through `active`, which starts out holding trampolines: the first call
+// into any kernel installs the variants for detected_simd_level().
+//
+// The json_* kernels are hand-written in fast_functions.asm. Each has a
+// *_scalar reference here that the tests compare it against.
+
+extern "C" {
+const char* json_skip_whitespace_avx2(const char* p, const char* end);
+const char* json_find_quote_or_backslash_avx2(const char* p, const char* end);
+int json_match_literal(const char* p, const char* end);
+int json_memcmp_bounded(const void* a, const void* b, std::size_t n);
+}
+
+// Returns the first byte in [p, end) that is not JSON whitespace, or end.
+using SkipWhitespaceFn = const char* (*)(const char* p, const char* end);
+
+const char* skip_whitespace_scalar(const char* p, const char* end);
+const char* skip_whitespace_sse2(const char* p, const char* end);
+const char* skip_whitespace_avx512(const char* p, const char* end);
+// AVX2: json_skip_whitespace_avx2
+
+// Returns the first '"', '\' or control character (< 0x20) in [p, end), or
+// end. Finding the quote first means the string has no escapes, which is
+// the common case; the AVX-512 tier uses the AVX2 variant.
+using FindQuoteOrBackslashFn = const char* (*)(const char* p, const char* end);
+
+const char* find_quote_or_backslash_scalar(const char* p, const char* end);
+const char* find_quote_or_backslash_sse2(const char* p, const char* end);
+// AVX2: json_find_quote_or_backslash_avx2
+
+// Scans string contents starting just after the opening quote and returns
+// the first byte that ends the scan: the closing (unescaped) quote, an
+// unescaped control character (< 0x20, not allowed in JSON strings), or end.
+// Backslash runs are resolved 64 bytes at a time, so in `\\"` the quote
+// closes the string while in `\"` it does not.
+using FindStringEndFn = const char* (*)(const char* p, const char* end);
+
+const char* find_string_end_scalar(const char* p, const char* end);
+const char* find_string_end_sse2(const char* p, const char* end);
+const char* find_string_end_avx2(const char* p, const char* end);
+const char* find_string_end_avx512(const char* p, const char* end);
+
+// Decodes the contents of a string (between its quotes) into `out`, which
+// must have room for `end - p` bytes; decoded text is never longer than its
+// source, and `out` may be `p` to decode in place. Unescaped runs are
+// copied a vector at a time and escapes, including \uXXXX surrogate pairs,
+// are converted to UTF-8. Returns one past the last byte written, or
+// nullptr on an invalid escape or a lone surrogate.
+// The AVX-512 tier uses the AVX2 variant.
+using DecodeStringFn = char* (*)(const char* p, const char* end, char* out);
+
+char* decode_string_scalar(const char* p, const char* end, char* out);
+char* decode_string_sse2(const char* p, const char* end, char* out);
+char* decode_string_avx2(const char* p, const char* end, char* out);
+
+// Returns true if [p, end) is well-formed UTF-8 (see utf8.hpp). The SSE2
+// tier uses the scalar variant and the AVX-512 tier the AVX2 one.
+using ValidateUtf8Fn = bool (*)(const char* p, const char* end);
+
+bool validate_utf8_scalar(const char* p, const char* end);
+bool validate_utf8_avx2(const char* p, const char* end);
+
+// Stage 1 (see structural_index.hpp): writes the offset of every structural
+// character, opening quote and scalar start in [data, data + length) to
+// `out`, which must have room for `length` entries. With `validate_utf8`
+// set, the same pass also checks that the input is well-formed UTF-8.
+// Defined in structural_index.cpp.
+struct IndexResult {
+    uint32_t* last;          // one past the last offset written
+    bool unterminated;       // the input ends inside a string, opened at the last offset
+    bool invalid_utf8;       // only ever set when validation was asked for
+};
+
+using IndexStructuralsFn = IndexResult (*)(const char* data, std::size_t length, uint32_t* out, bool validate_utf8);
+
+IndexResult index_structurals_scalar(const char* data, std::size_t length, uint32_t* out, bool validate_utf8);
+IndexResult index_structurals_sse2(const char* data, std::size_t length, uint32_t* out, bool validate_utf8);
+IndexResult index_structurals_avx2(const char* data, std::size_t length, uint32_t* out, bool validate_utf8);
+IndexResult index_structurals_avx512(const char* data, std::size_t length, uint32_t* out, bool validate_utf8);
+
+// Identifies the literal at p without reading past end; the value is what
+// json_match_literal returns.
+enum class Literal : int {
+    None = 0,
+    True = 1,
+    False = 2,
+    Null = 3
+};
+
+Literal match_literal_scalar(const char* p, const char* end);
+
+inline Literal match_literal(const char* p, const char* end) {
+    return static_cast<Literal>(json_match_literal(p, end));
+}
+
+// memcmp over exactly n bytes, used to compare object keys.
+int memcmp_bounded_scalar(const void* a, const void* b, std::size_t n);
+
+inline int memcmp_bounded(const void* a, const void* b, std::size_t n) {
+    return json_memcmp_bounded(a, b, n);
+}
+
+struct KernelTable {
+    std::atomic<SkipWhitespaceFn> skip_whitespace;
+    std::atomic<FindQuoteOrBackslashFn> find_quote_or_backslash;
+    std::atomic<FindStringEndFn> find_string_end;
+    std::atomic<DecodeStringFn> decode_string;
+    std::atomic<ValidateUtf8Fn> validate_utf8;
+    std::atomic<IndexStructuralsFn> index_structurals;
+};
+
+extern KernelTable active;
+
+// Installs the variants for `level`, capped at detected_simd_level(). Meant
+// for tests and benchmarks; returns the level actually installed.
+SimdLevel use_simd_level(SimdLevel level);
+
+// The level whose variants are installed (resolving them if needed).
+SimdLevel active_simd_level();
+
+inline const char* skip_whitespace(const char* p, const char* end) {
+    return active.skip_whitespace.load(std::memory_order_relaxed)(p, end);
+}
+
+inline const char* find_quote_or_backslash(const char* p, const char* end) {
+    return active.find_quote_or_backslash.load(std::memory_order_relaxed)(p, end);
+}
+
+inline const char* find_string_end(const char* p, const char* end) {
+    return active.find_string_end.load(std::memory_order_relaxed)(p, end);
+}
+
+inline char* decode_string(const char* p, const char* end, char* out) {
+    return active.decode_string.load(std::memory_order_relaxed)(p, end, out);
+}
+
+inline bool validate_utf8(const char* p, const char* end) {
+    return active.validate_utf8.load(std::memory_order_relaxed)(p, end);
+}
+
+inline IndexResult index_structurals(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    return active.index_structurals.load(std::memory_order_relaxed)(data, length, out, validate_utf8);
+}
+
+} // namespace custom_json::kernels
@@ -0,0 +1,321 @@
+#include "lazy.hpp"
+#include "stage2.hpp"
+#include <vector>
+
+namespace custom_json {
+
+// The kinds of the brackets open while skipping, one bit per level (set
+// for an object). Nothing is allocated until nesting is 64 deep.
+class BracketStack {
+public:
+    std::size_t depth() const { return depth_; }
+    bool top_is_object() const { return top_ & 1; }
+
+    void push(bool object) {
+        if (depth_ != 0 && depth_ % 64 == 0) {
+            below_.push_back(top_);
+            top_ = 0;
+        }
+        top_ = top_ << 1 | uint64_t(object);
+        ++depth_;
+    }
+
+    void pop() {
+        top_ >>= 1;
+        if (--depth_ != 0 && depth_ % 64 == 0) {
+            top_ = below_.back();
+            below_.pop_back();
+        }
+    }
+
+private:
+    uint64_t top_ = 0;             // the innermost levels, innermost lowest
+    std::vector<uint64_t> below_;  // 64 levels per word, beyond those
+    std::size_t depth_ = 0;
+};
+
+// Skips the value at the cursor and returns one past its last byte, or
+// nullptr on an error. Strings are scanned for their closing quote,
+// containers for their closing bracket and scalars for the byte after them;
+// nothing is decoded. Each closing bracket must match the one it closes.
+static const char* skip_value(ByteCursor& cur) {
+    const char* p = cur.token();
+    const char* end = cur.end();
+    if (p >= end) {
+        cur.fail(ParseErrorCode::UnexpectedEnd, end);
+        return nullptr;
+    }
+    switch (*p) {
+        case '"': {
+            RawString s;
+            if (!scan_string(cur, p, s)) return nullptr;
+            break;
+        }
+        case '[': case '{': {
+            BracketStack open;
+            while (true) {
+                if (p >= end) {
+                    cur.fail(open.top_is_object() ? ParseErrorCode::ExpectedObjectEnd : ParseErrorCode::ExpectedArrayEnd, end);
+                    return nullptr;
+                }
+                if (*p == '"') {
+                    RawString s;
+                    if (!scan_string(cur, p, s)) return nullptr;
+                    continue;
+                }
+                if (*p == '[' || *p == '{') {
+                    open.push(*p == '{');
+                } else if (*p == ']' || *p == '}') {
+                    if (open.top_is_object() != (*p == '}')) {
+                        cur.fail(open.top_is_object() ? ParseErrorCode::ExpectedObjectEnd : ParseErrorCode::ExpectedArrayEnd, p);
+                        return nullptr;
+                    }
+                    open.pop();
+                    if (open.depth() == 0) {
+                        ++p;
+                        break;
+                    }
+                }
+                ++p;
+            }
+            break;
+        }
+        case ',': case ':': case ']': case '}':
+            cur.fail(ParseErrorCode::UnrecognizedValue, p);
+            return nullptr;
+        default:
+            do ++p; while (!is_scalar_terminator(p, end));
+            break;
+    }
+    cur.consume(p);
+    return p;
+}
+
+// Moves the cursor from a member's key to its value.
+static bool skip_key(ByteCursor& cur, RawString& key) {
+    if (cur.peek() != '"') return cur.fail(ParseErrorCode::ExpectedKey, cur.token());
+    const char* p = cur.token();
+    if (!scan_string(cur, p, key)) return false;
+    cur.consume(p);
+    if (cur.peek() != ':') return cur.fail(ParseErrorCode::ExpectedColon, cur.token());
+    cur.consume(cur.token() + 1);
+    if (cur.token() == cur.end()) return cur.fail(ParseErrorCode::UnexpectedEnd, cur.end());
+    return true;
+}
+
+// Moves the cursor from a member's value to the next member's key, or to
+// the closing brace.
+static bool next_member(ByteCursor& cur) {
+    if (!skip_value(cur)) return false;
+    if (cur.peek() == '}') return true;
+    if (cur.peek() != ',') return cur.fail(ParseErrorCode::ExpectedObjectEnd, cur.token());
+    cur.consume(cur.token() + 1);
+    if (cur.peek() != '"') return cur.fail(ParseErrorCode::ExpectedKey, cur.token());
+    return true;
+}
+
+// Moves the cursor from an element to the next one, or to the closing
+// bracket.
+static bool next_element(ByteCursor& cur) {
+    if (!skip_value(cur)) return false;
+    if (cur.peek() == ']') return true;
+    if (cur.peek() != ',') return cur.fail(ParseErrorCode::ExpectedArrayEnd, cur.token());
+    cur.consume(cur.token() + 1);
+    if (cur.token() == cur.end()) return cur.fail(ParseErrorCode::UnexpectedEnd, cur.end());
+    if (cur.peek() == ']' || cur.peek() == '}') return cur.fail(ParseErrorCode::UnrecognizedValue, cur.token());
+    return true;
+}
+
+LazyValue LazyDocument::root() {
+    ByteCursor cur(json_.data(), end(), false);
+    if (cur.token() == end()) fail(ParseErrorCode::UnexpectedEnd, end());
+    return LazyValue(this, cur.token());
+}
+
+void LazyDocument::fail(ParseErrorCode code, const char* at) const {
+    throw_parse_error(ParseError{code, static_cast<std::size_t>(at - json_.data())}, json_);
+}
+
+std::string_view LazyDocument::decode(std::string_view escaped, bool keep) {
+    std::string& out = keep ? decoded_.emplace_front() : key_buffer_;
+    out.resize(escaped.size());
+    char* last = kernels::decode_string(escaped.data(), escaped.data() + escaped.size(), out.data());
+    if (!last) fail(ParseErrorCode::InvalidEscape, escaped.data() - 1);
+    out.resize(static_cast<std::size_t>(last - out.data()));
+    return out;
+}
+
+bool LazyValue::is_null() const {
+    if (*begin_ != 'n') return false;
+    if (kernels::match_literal(begin_, doc_->end()) != kernels::Literal::Null || !is_scalar_terminator(begin_ + 4, doc_->end())) {
+        doc_->fail(ParseErrorCode::UnrecognizedValue, begin_);
+    }
+    return true;
+}
+
+Value::Type LazyValue::type() const {
+    switch (*begin_) {
+        case 'n': return Value::Type::Null;
+        case 't': case 'f': return Value::Type::Boolean;
+        case '"': return Value::Type::String;
+        case '[': return Value::Type::Array;
+        case '{': return Value::Type::Object;
+        default: return Value::Type::Number;
+    }
+}
+
+const char* LazyValue::end() const {
+    ByteCursor cur(begin_, doc_->end(), false);
+    const char* after = skip_value(cur);
+    if (!after) doc_->fail(cur.code(), cur.at());
+    return after;
+}
+
+std::optional<LazyValue> LazyValue::find(std::string_view key) {
+    if (*begin_ != '{') throw std::runtime_error("Value is not an object");
+    ByteCursor cur(begin_ + 1, doc_->end(), false);
+    if (cur.peek() != '}' && cur.peek() != '"') doc_->fail(ParseErrorCode::ExpectedKey, cur.token());
+    const char* first = cur.token();
+
+    // Searches the members from the one at the cursor up to the closing
+    // brace or `stop`, and returns the position of the matching one's value.
+    const auto search = [&](const char* stop) -> const char* {
+        while (cur.peek() == '"' && cur.token() != stop) {
+            RawString name;
+            if (!skip_key(cur, name)) doc_->fail(cur.code(), cur.at());
+            bool match;
+            if (!name.escaped) {
+                match = name.size() == key.size() && std::memcmp(name.begin, key.data(), key.size()) == 0;
+            } else {
+                // Decoding never makes a key longer
+                match = name.size() >= key.size() && doc_->decode({name.begin, name.size()}, false) == key;
+            }
+            if (match) return cur.token();
+            if (!next_member(cur)) doc_->fail(cur.code(), cur.at());
+        }
+        return nullptr;
+    };
+
+    const char* found;
+    if (!resume_) {
+        found = search(nullptr);
+    } else {
+        cur.consume(resume_);
+        if (!next_member(cur)) doc_->fail(cur.code(), cur.at());
+        const char* wrap = cur.token();
+        found = search(nullptr);
+        if (!found) {
+            cur.consume(first);
+            found = search(wrap);
+        }
+    }
+    if (!found) return std::nullopt;
+    resume_ = found;
+    return LazyValue(doc_, found);
+}
+
+LazyValue LazyValue::operator[](std::string_view key) {
+    if (std::optional<LazyValue> value = find(key)) return *value;
+    throw std::out_of_range("No member named " + std::string(key));
+}
+
+LazyValue LazyValue::operator[](std::size_t index) const {
+    for (LazyValue element : get_array()) {
+        if (index-- == 0) return element;
+    }
+    throw std::out_of_range("Array index out of range");
+}
+
+std::string_view LazyValue::get_string() const {
+    if (*begin_ != '"') throw std::runtime_error("Value is not a string");
+    ByteCursor cur(begin_, doc_->end(), false);
+    const char* p = begin_;
+    RawString s;
+    if (!scan_string(cur, p, s)) doc_->fail(cur.code(), cur.at());
+    if (!s.escaped) return {s.begin, s.size()};
+    return doc_->decode({s.begin, s.size()}, true);
+}
+
+Value LazyValue::number() const {
+    if (type() != Value::Type::Number) throw std::runtime_error("Value is not a number");
+    Number num;
+    const char* after = parse_number(begin_, doc_->end(), num);
+    if (!after || !is_scalar_terminator(after, doc_->end())) doc_->fail(ParseErrorCode::InvalidNumber, begin_);
+    switch (num.kind) {
+        case Number::Kind::Int64: return Value(num.i);
+        case Number::Kind::UInt64: return Value(num.u);
+        default: return Value(num.d);
+    }
+}
+
+double LazyValue::get_double() const { return number().as_number(); }
+int64_t LazyValue::get_int64() const { return number().as_int64(); }
+uint64_t LazyValue::get_uint64() const { return number().as_uint64(); }
+
+bool LazyValue::get_bool() const {
+    if (*begin_ != 't' && *begin_ != 'f') throw std::runtime_error("Value is not a boolean");
+    const kernels::Literal literal = kernels::match_literal(begin_, doc_->end());
+    const char* after = begin_ + (literal == kernels::Literal::False ? 5 : 4);
+    if (literal == kernels::Literal::None || literal == kernels::Literal::Null || !is_scalar_terminator(after, doc_->end())) {
+        doc_->fail(ParseErrorCode::UnrecognizedValue, begin_);
+    }
+    return literal == kernels::Literal::True;
+}
+
+LazyArray LazyValue::get_array() const {
+    if (*begin_ != '[') throw std::runtime_error("Value is not an array");
+    return LazyArray(*this);
+}
+
+LazyObject LazyValue::get_object() const {
+    if (*begin_ != '{') throw std::runtime_error("Value is not an object");
+    return LazyObject(*this);
+}
+
+std::string_view LazyValue::raw_json() const {
+    return {begin_, static_cast<std::size_t>(end() - begin_)};
+}
+
+Value LazyValue::to_value() const {
+    const std::string_view text = raw_json();
+    std::expected<Value, ParseError> result = try_parse(text);
+    if (!result) doc_->fail(result.error().code, text.data() + result.error().offset);
+    return std::move(*result);
+}
+
+LazyArray::iterator LazyArray::begin() const {
+    ByteCursor cur(array_.begin_ + 1, array_.doc_->end(), false);
+    if (cur.token() == cur.end()) array_.doc_->fail(ParseErrorCode::ExpectedArrayEnd, cur.end());
+    return iterator(array_.doc_, cur.token());
+}
+
+LazyArray::iterator& LazyArray::iterator::operator++() {
+    ByteCursor cur(at_, doc_->end(), false);
+    if (!next_element(cur)) doc_->fail(cur.code(), cur.at());
+    at_ = cur.token();
+    return *this;
+}
+
+LazyObject::iterator LazyObject::begin() const {
+    ByteCursor cur(object_.begin_ + 1, object_.doc_->end(), false);
+    if (cur.peek() != '}' && cur.peek() != '"') object_.doc_->fail(ParseErrorCode::ExpectedKey, cur.token());
+    return iterator(object_.doc_, cur.token());
+}
+
+LazyMember LazyObject::iterator::operator*() const {
+    ByteCursor cur(at_, doc_->end(), false);
+    RawString name;
+    if (!skip_key(cur, name)) doc_->fail(cur.code(), cur.at());
+    const std::string_view key = name.escaped ? doc_->decode({name.begin, name.size()}, true) : std::string_view(name.begin, name.size());
+    return {key, LazyValue(doc_, cur.token())};
+}
+
+LazyObject::iterator& LazyObject::iterator::operator++() {
+    ByteCursor cur(at_, doc_->end(), false);
+    RawString name;
+    if (!skip_key(cur, name) || !next_member(cur)) doc_->fail(cur.code(), cur.at());
+    at_ = cur.token();
+    return *this;
+}
+
+} // namespace custom_json
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "json_parser.hpp"
+#include <forward_list>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+namespace custom_json {
+
+// On-demand access to a document that is never parsed as a whole. Each
+// lookup scans forward through the input from the value it starts at,
+// stepping over members and elements it was not asked for by matching
+// brackets and string quotes: nothing in a skipped subtree is decoded or
+// allocated. Only the values actually read are parsed in full.
+//
+//   LazyDocument doc(json);
+//   std::string_view name = doc["company"]["name"].get_string();
+//
+// Malformed JSON is reported by throwing std::runtime_error with its line
+// and column, as parse() does, when a scan runs into it. Skipped subtrees
+// are only checked for terminated strings and matching brackets, and what
+// is never scanned is never checked.
+
+class LazyDocument;
+class LazyArray;
+class LazyObject;
+
+// A value somewhere in a LazyDocument: a position in the input. Cheap to
+// copy; valid while the document lives.
+class LazyValue {
+public:
+    // Found from the value's first byte, without scanning it.
+    Value::Type type() const;
+    // Checks the literal, as get_bool() does.
+    bool is_null() const;
+
+    // Member lookup. A lookup starts where the last one on this LazyValue
+    // stopped and wraps around, so reading fields in the order they appear
+    // takes one pass over the object; with duplicate keys, which member is
+    // found depends on that. Throws std::out_of_range if there is none.
+    LazyValue operator[](std::string_view key);
+    std::optional<LazyValue> find(std::string_view key);
+
+    // Array indexing; skips the elements before `index`.
+    LazyValue operator[](std::size_t index) const;
+
+    // Scalar accessors, with the conversions of Value's. They throw
+    // std::runtime_error on a type mismatch. An unescaped string is a view
+    // of the input; an escaped one is decoded into the document.
+    std::string_view get_string() const;
+    double get_double() const;
+    int64_t get_int64() const;
+    uint64_t get_uint64() const;
+    bool get_bool() const;
+
+    LazyArray get_array() const;
+    LazyObject get_object() const;
+
+    // The value's text, exactly as it appears in the input.
+    std::string_view raw_json() const;
+
+    // Parses this value and everything under it into a tree.
+    Value to_value() const;
+
+private:
+    friend class LazyDocument;
+    friend class LazyArray;
+    friend class LazyObject;
+
+    LazyValue(LazyDocument* doc, const char* begin) : doc_(doc), begin_(begin) {}
+
+    const char* end() const;  // one past the value's last byte
+    Value number() const;     // as a scalar Value, for its conversions
+
+    LazyDocument* doc_;
+    const char* begin_;             // the value's first byte
+    const char* resume_ = nullptr;  // the value of the member last found, if any
+};
+
+// A member of an object, as produced by iterating a LazyObject.
+struct LazyMember {
+    std::string_view key;
+    LazyValue value;
+};
+
+// Single-pass iteration over an array's elements or an object's members.
+// Each step skips whatever part of the current value was not read.
+class LazyArray {
+public:
+    class iterator {
+    public:
+        using value_type = LazyValue;
+        using difference_type = std::ptrdiff_t;
+
+        LazyValue operator*() const { return LazyValue(doc_, at_); }
+        iterator& operator++();
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return *at_ == ']'; }
+
+    private:
+        friend class LazyArray;
+        iterator(LazyDocument* doc, const char* at) : doc_(doc), at_(at) {}
+        LazyDocument* doc_;
+        const char* at_;  // the current element, or the closing bracket
+    };
+
+    iterator begin() const;
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    friend class LazyValue;
+    explicit LazyArray(LazyValue array) : array_(array) {}
+    LazyValue array_;
+};
+
+class LazyObject {
+public:
+    class iterator {
+    public:
+        using value_type = LazyMember;
+        using difference_type = std::ptrdiff_t;
+
+        LazyMember operator*() const;
+        iterator& operator++();
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return *at_ == '}'; }
+
+    private:
+        friend class LazyObject;
+        iterator(LazyDocument* doc, const char* at) : doc_(doc), at_(at) {}
+        LazyDocument* doc_;
+        const char* at_;  // the current member's key, or the closing brace
+    };
+
+    iterator begin() const;
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    friend class LazyValue;
+    explicit LazyObject(LazyValue object) : object_(object) {}
+    LazyValue object_;
+};
+
+// The input must outlive the document. Values refer back to the document
+// for the strings they decode, so it can be neither copied nor moved.
+class LazyDocument {
+public:
+    explicit LazyDocument(std::string_view json) : json_(json) {}
+    LazyDocument(const LazyDocument&) = delete;
+    LazyDocument& operator=(const LazyDocument&) = delete;
+
+    // Throws std::runtime_error if the input holds no value.
+    LazyValue root();
+    LazyValue operator[](std::string_view key) { return root()[key]; }
+
+private:
+    friend class LazyValue;
+    friend class LazyArray;
+    friend class LazyObject;
+
+    const char* end() const { return json_.data() + json_.size(); }
+    [[noreturn]] void fail(ParseErrorCode code, const char* at) const;
+
+    // Decodes the contents of an escaped string: into storage that lasts as
+    // long as the document if `keep` is set, and otherwise into a buffer
+    // that the next call reuses.
+    std::string_view decode(std::string_view escaped, bool keep);
+
+    std::string_view json_;
+    std::forward_list<std::string> decoded_;  // escaped strings read so far
+    std::string key_buffer_;                  // an escaped key being compared
+};
+
+} // namespace custom_json
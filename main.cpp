@@ -7,6 +7,9 @@
 #include "json_parser.hpp"
 
 void print_current_datetime();
+void benchmark_kernels(const std::string& directory_path);
+void benchmark_strings(const std::string& directory_path);
+void benchmark_ndjson(const std::string& directory_path);
 
 namespace fs = std::filesystem;
 using nlohmann_json = nlohmann::json;
@@ -64,13 +67,26 @@ int main(int argc, char* argv[]) {
     std::cout << "Built " << __DATE__ << " T " << __TIME__ << std::endl;
 
     if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <custom|nlohmann> <json_directory_path>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <custom|nlohmann|kernels|strings|ndjson> <json_directory_path>" << std::endl;
         return 1;
     }
 
     std::string parser_type = argv[1];
     std::string directory_path = argv[2];
 
+    if (parser_type == "kernels") {
+        benchmark_kernels(directory_path);
+        return 0;
+    }
+    if (parser_type == "strings") {
+        benchmark_strings(directory_path);
+        return 0;
+    }
+    if (parser_type == "ndjson") {
+        benchmark_ndjson(directory_path);
+        return 0;
+    }
+
     for (const auto & entry : fs::directory_iterator(directory_path)) {
         if (entry.path().extension() == ".json") {
             try {
@@ -79,7 +95,7 @@ int main(int argc, char* argv[]) {
                 } else if (parser_type == "nlohmann") {
                     benchmark_nlohmann(entry.path().string());
                 } else {
-                    std::cerr << "Invalid parser type. Use 'custom' or 'nlohmann'." << std::endl;
+                    std::cerr << "Invalid parser type. Use 'custom', 'nlohmann', 'kernels', 'strings' or 'ndjson'." << std::endl;
                     return 1;
                 }
             } catch (const std::exception& e) {
@@ -0,0 +1,153 @@
+#include "ndjson.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace custom_json {
+
+// A batch's records, parsed by a worker and waiting to be visited.
+struct NdjsonBatch {
+    std::vector<Value> values;
+    std::optional<ParseError> error;  // the record the batch stopped at
+    std::exception_ptr exception;
+    bool ready = false;
+};
+
+// Where the batch that nominally starts at `at` begins: a record belongs to
+// the batch its first byte falls in, so this is just past the first newline
+// at or after at - 1. Each worker finds its own bounds this way, without a
+// pass over the input before parsing can start.
+static std::size_t batch_start(std::string_view input, std::size_t at) {
+    if (at == 0) return 0;
+    if (at >= input.size()) return input.size();
+    const void* newline = std::memchr(input.data() + at - 1, '\n', input.size() - at + 1);
+    return newline ? static_cast<std::size_t>(static_cast<const char*>(newline) - input.data()) + 1 : input.size();
+}
+
+// Parses the records of batch `k`, handing each to `emit` as it is parsed.
+// Returns the error at the record the batch stopped at, if any.
+template<typename Emit>
+static std::optional<ParseError> parse_batch(std::string_view input, std::size_t k, const NdjsonOptions& options,
+                                             Emit&& emit) {
+    const char* p = input.data() + batch_start(input, k * options.batch_size);
+    const char* end = input.data() + batch_start(input, (k + 1) * options.batch_size);
+    while (p < end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        const char* line_end = newline ? newline : end;
+        if (kernels::skip_whitespace(p, line_end) != line_end) {
+            std::expected<Value, ParseError> record = try_parse({p, line_end}, options.parse);
+            if (!record) {
+                const std::size_t offset = static_cast<std::size_t>(p - input.data()) + record.error().offset;
+                return ParseError{record.error().code, offset};
+            }
+            emit(std::move(*record));
+        }
+        p = line_end + 1;
+    }
+    return std::nullopt;
+}
+
+std::expected<void, ParseError> try_parse_ndjson(std::string_view input, const std::function<void(Value&&)>& visit,
+                                                 const NdjsonOptions& user_options) {
+    NdjsonOptions options = user_options;
+    options.batch_size = std::max<std::size_t>(options.batch_size, 1);
+    const std::size_t batches = (input.size() + options.batch_size - 1) / options.batch_size;
+    const std::size_t threads = std::min<std::size_t>(
+        options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency()), batches);
+
+    // With one thread, each record is visited as soon as it is parsed,
+    // while its nodes are still in cache.
+    if (threads <= 1) {
+        for (std::size_t k = 0; k < batches; ++k) {
+            if (auto error = parse_batch(input, k, options, visit)) return std::unexpected(*error);
+        }
+        return {};
+    }
+
+    // Workers claim batches in order and fill a ring of slots, two per
+    // thread; the calling thread empties the slots in order, and a worker
+    // waits rather than claim a batch whose slot has not been emptied.
+    const std::size_t window = 2 * threads;
+    std::vector<NdjsonBatch> slots(window);
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t claimed = 0;
+    std::size_t visited = 0;
+    bool stop = false;
+
+    const auto work = [&] {
+        while (true) {
+            std::size_t k;
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return stop || claimed == batches || claimed < visited + window; });
+                if (stop || claimed == batches) return;
+                k = claimed++;
+            }
+            NdjsonBatch& batch = slots[k % window];
+            try {
+                batch.error = parse_batch(input, k, options, [&](Value&& value) { batch.values.push_back(std::move(value)); });
+            } catch (...) {
+                batch.exception = std::current_exception();
+            }
+            {
+                std::lock_guard lock(mutex);
+                batch.ready = true;
+            }
+            changed.notify_all();
+        }
+    };
+    const auto halt = [&] {
+        {
+            std::lock_guard lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+    };
+
+    std::vector<std::jthread> workers;  // joined before the state above goes
+    std::vector<Value> values;
+    std::optional<ParseError> error;
+    try {
+        for (std::size_t i = 0; i < threads; ++i) workers.emplace_back(work);
+        for (std::size_t k = 0; k < batches && !error; ++k) {
+            NdjsonBatch& batch = slots[k % window];
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return batch.ready; });
+            }
+            if (batch.exception) std::rethrow_exception(batch.exception);
+            values.swap(batch.values);  // leaves the slot the empty vector, keeping its capacity
+            error = batch.error;
+            batch.error.reset();
+            {
+                std::lock_guard lock(mutex);
+                batch.ready = false;
+                ++visited;
+            }
+            changed.notify_all();
+            for (Value& value : values) visit(std::move(value));
+            values.clear();
+        }
+    } catch (...) {
+        halt();
+        throw;
+    }
+    halt();
+    if (error) return std::unexpected(*error);
+    return {};
+}
+
+std::vector<Value> parse_ndjson(std::string_view input, const NdjsonOptions& options) {
+    std::vector<Value> records;
+    const auto parsed = try_parse_ndjson(input, [&](Value&& record) { records.push_back(std::move(record)); }, options);
+    if (!parsed) throw_parse_error(parsed.error(), input);
+    return records;
+}
+
+} // namespace custom_json
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "json_parser.hpp"
+#include <functional>
+#include <vector>
+
+namespace custom_json {
+
+// Newline-delimited JSON (NDJSON, JSON Lines): one document per line.
+// The input is cut into batches of about batch_size bytes, each ending at a
+// newline, and the batches are parsed on a pool of threads. Records still
+// come out in input order, on the calling thread; workers run at most a few
+// batches ahead of it, so memory stays bounded however long the input is.
+//
+// A newline cannot appear inside a valid JSON string, so every newline
+// byte ends a record. Blank lines are skipped, and a line may end in
+// "\r\n".
+struct NdjsonOptions {
+    ParseOptions parse{};              // applied to each record
+    unsigned threads = 0;              // 0: one per hardware thread
+    std::size_t batch_size = 1 << 20;  // bytes of input per batch
+};
+
+// Calls `visit` with each record in input order. Parsing stops at the
+// first malformed record, after visiting the ones before it; the error's
+// offset is into the whole input. An exception thrown by `visit` stops
+// the workers and propagates.
+std::expected<void, ParseError> try_parse_ndjson(std::string_view input, const std::function<void(Value&&)>& visit,
+                                                 const NdjsonOptions& options = {});
+
+// Every record, in input order. Throws std::runtime_error naming the
+// malformed record's line, as parse() does.
+std::vector<Value> parse_ndjson(std::string_view input, const NdjsonOptions& options = {});
+
+} // namespace custom_json
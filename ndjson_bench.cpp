@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "ndjson.hpp"
+
+// Measures NDJSON throughput as the thread count grows. The input is the
+// directory's documents, each put on one line, repeated to about 64 MB.
+
+namespace fs = std::filesystem;
+
+void benchmark_ndjson(const std::string& directory_path) {
+    std::string lines;
+    for (const auto& entry : fs::directory_iterator(directory_path)) {
+        if (entry.path().extension() == ".json") {
+            std::ifstream file(entry.path());
+            std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (!custom_json::try_parse(json)) continue;
+            // A newline cannot be inside a valid string, so this only joins lines.
+            std::replace(json.begin(), json.end(), '\n', ' ');
+            lines += json + '\n';
+        }
+    }
+    if (lines.empty()) return;
+    std::string input;
+    while (input.size() < (64 << 20)) input += lines;
+
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1;; threads = std::min(threads * 2, hardware)) {
+        std::size_t records = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        const auto parsed = custom_json::try_parse_ndjson(input, [&](custom_json::Value&&) { ++records; }, {.threads = threads});
+        const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+        if (!parsed) return;
+        std::cout << threads << " threads: " << static_cast<double>(input.size()) / duration.count() / 1e6 << " MB/s, "
+                  << records << " records" << std::endl;
+        if (threads == hardware) break;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+namespace custom_json {
+
+// A parsed JSON number in its narrowest exact representation.
+struct Number {
+    enum class Kind { Int64, UInt64, Double };
+
+    Kind kind;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+};
+
+// Parses a JSON number starting at `p`, without reading past `end` and
+// independent of the C locale. The text must match the JSON grammar
+//     -? (0 | [1-9][0-9]*) (. [0-9]+)? ([eE] [+-]? [0-9]+)?
+// Numbers without a fraction or exponent that fit in int64_t (or, when
+// positive, uint64_t) are returned as integers and never go through floating
+// point. Everything else is converted to the nearest double (round half to
+// even); magnitudes beyond the double range become infinity or zero, as with
+// strtod.
+// Returns one past the last byte of the number, or nullptr if the text is
+// not a valid number.
+const char* parse_number(const char* p, const char* end, Number& number);
+
+} // namespace custom_json
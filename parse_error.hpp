@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace custom_json {
+
+enum class ParseErrorCode {
+    UnexpectedEnd,
+    UnrecognizedValue,
+    InvalidNumber,
+    UnterminatedString,
+    InvalidEscape,
+    ControlCharacterInString,
+    InvalidUtf8,
+    ExpectedKey,
+    ExpectedColon,
+    ExpectedArrayEnd,
+    ExpectedObjectEnd,
+    TrailingCharacters,
+    DocumentTooLarge
+};
+
+// What went wrong and the byte offset into the input where it was found.
+// Line and column are not tracked while parsing; location() works them out
+// from the input only when asked.
+struct ParseError {
+    ParseErrorCode code;
+    std::size_t offset;
+
+    struct Location {
+        std::size_t line;    // 1-based
+        std::size_t column;  // 1-based, in bytes
+    };
+
+    // `json` must be the input that produced this error.
+    Location location(std::string_view json) const;
+};
+
+const char* to_string(ParseErrorCode code);
+
+// Throws std::runtime_error naming the error and its line and column.
+[[noreturn]] void throw_parse_error(const ParseError& error, std::string_view json);
+
+} // namespace custom_json
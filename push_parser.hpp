@@ -0,0 +1,326 @@
+#pragma once
+
+#include "sax.hpp"
+#include <span>
+#include <string>
+#include <vector>
+
+namespace custom_json {
+
+// Incremental parsing of a document that arrives in pieces, such as reads
+// from a socket. Each feed() parses as far as the bytes allow and reports
+// events to a SaxHandler as it goes; a string, number or literal cut off by
+// the end of a chunk is carried over to the next one. Only such split
+// tokens are copied, so memory use is bounded by the nesting depth and the
+// longest token rather than by the document.
+//
+//   PushParser<ValueHandler> parser(handler);
+//   while (receiving) if (auto done = parser.feed(chunk); !done || *done) break;
+//
+// Errors carry the offset into the whole input, as with try_parse(). A
+// number or literal at the top level has nothing after it to end it, so
+// the document is only complete once finish() says there is no more input.
+template<SaxHandler Handler>
+class PushParser {
+public:
+    explicit PushParser(Handler& handler, const ParseOptions& options = {}) : builder_(handler), options_(options) {}
+
+    // Parses the next piece of input. Returns true once a whole document
+    // has been read; after that only whitespace may follow.
+    std::expected<bool, ParseError> feed(std::span<const char> chunk) {
+        if (failed_) return std::unexpected(error_);
+        const char* p = chunk.data();
+        const char* end = p + chunk.size();
+        chunk_ = p;
+        paused_ = false;
+        while (p < end && !failed_ && !paused_) {
+            if (token_ != Token::None) {
+                p = resume_token(p, end);
+                continue;
+            }
+            if (skip_whitespace(p, end) < end) p = step(p, end);
+        }
+        unread_ = static_cast<std::size_t>(end - p);
+        consumed_ += chunk.size() - unread_;
+        if (failed_) return std::unexpected(error_);
+        return expect_ == Expect::Done;
+    }
+
+    // For the handler to call from an event: the current feed() returns
+    // once the token that raised the event is parsed, leaving the rest of
+    // the chunk for the caller to feed again. This lets a consumer act on
+    // each value before the parser moves past it.
+    void pause() { paused_ = true; }
+
+    // The bytes at the end of the last chunk left unparsed by pause().
+    std::size_t unread() const { return unread_; }
+
+    // Ends the input, completing a top-level number or literal. Fails if
+    // the document is not complete.
+    std::expected<void, ParseError> finish() {
+        if (!failed_ && token_ == Token::Scalar) end_scalar(nullptr, 0);
+        if (failed_) return std::unexpected(error_);
+        if (expect_ != Expect::Done) {
+            const ParseErrorCode code = token_ == Token::String ? ParseErrorCode::UnterminatedString : unfinished();
+            return std::unexpected(ParseError{code, token_ == Token::String ? token_start_ : consumed_});
+        }
+        return {};
+    }
+
+    // Starts over for a new document, keeping the buffers.
+    void reset() {
+        stack_.clear();
+        stash_.clear();
+        expect_ = Expect::Value;
+        token_ = Token::None;
+        escape_pending_ = false;
+        failed_ = false;
+        paused_ = false;
+        unread_ = 0;
+        consumed_ = 0;
+    }
+
+private:
+    // What the grammar allows next.
+    enum class Expect { Value, ValueOrEnd, Key, KeyOrEnd, Colon, CommaOrEnd, Done };
+    // A token that began in an earlier chunk and is held in stash_.
+    enum class Token { None, String, Scalar };
+
+    std::size_t offset(const char* p) const { return consumed_ + static_cast<std::size_t>(p - chunk_); }
+
+    void fail(ParseErrorCode code, std::size_t at) {
+        failed_ = true;
+        error_ = {code, at};
+    }
+
+    // The error for running out of input part way through a document.
+    ParseErrorCode unfinished() const {
+        if (stack_.empty()) return ParseErrorCode::UnexpectedEnd;
+        switch (expect_) {
+            case Expect::Value: case Expect::ValueOrEnd: case Expect::Colon: return ParseErrorCode::UnexpectedEnd;
+            case Expect::Key: case Expect::KeyOrEnd: return ParseErrorCode::ExpectedKey;
+            default: return stack_.back() == '[' ? ParseErrorCode::ExpectedArrayEnd : ParseErrorCode::ExpectedObjectEnd;
+        }
+    }
+
+    void value_done() { expect_ = stack_.empty() ? Expect::Done : Expect::CommaOrEnd; }
+
+    void close(char open) {
+        stack_.pop_back();
+        if (open == '[') builder_.end_array();
+        else builder_.end_object();
+        value_done();
+    }
+
+    // Handles the token starting at `p`, which is not whitespace, and
+    // returns where to carry on.
+    const char* step(const char* p, const char* end) {
+        const char c = *p;
+        switch (expect_) {
+            case Expect::Done:
+                fail(ParseErrorCode::TrailingCharacters, offset(p));
+                return end;
+            case Expect::Colon:
+                if (c != ':') fail(ParseErrorCode::ExpectedColon, offset(p));
+                expect_ = Expect::Value;
+                return p + 1;
+            case Expect::CommaOrEnd: {
+                const char open = stack_.back();
+                if (c == ',') {
+                    expect_ = open == '[' ? Expect::Value : Expect::Key;
+                } else if (c == (open == '[' ? ']' : '}')) {
+                    close(open);
+                } else {
+                    fail(open == '[' ? ParseErrorCode::ExpectedArrayEnd : ParseErrorCode::ExpectedObjectEnd, offset(p));
+                }
+                return p + 1;
+            }
+            case Expect::KeyOrEnd:
+                if (c == '}') {
+                    close('{');
+                    return p + 1;
+                }
+                [[fallthrough]];
+            case Expect::Key:
+                if (c != '"') {
+                    fail(ParseErrorCode::ExpectedKey, offset(p));
+                    return end;
+                }
+                return start_string(p, end, true);
+            case Expect::ValueOrEnd:
+                if (c == ']') {
+                    close('[');
+                    return p + 1;
+                }
+                [[fallthrough]];
+            case Expect::Value:
+                break;
+        }
+        switch (c) {
+            case '"':
+                return start_string(p, end, false);
+            case '[':
+                builder_.start_array();
+                stack_.push_back('[');
+                expect_ = Expect::ValueOrEnd;
+                return p + 1;
+            case '{':
+                builder_.start_object();
+                stack_.push_back('{');
+                expect_ = Expect::KeyOrEnd;
+                return p + 1;
+            case ',': case ':': case ']': case '}':
+                fail(ParseErrorCode::UnrecognizedValue, offset(p));
+                return end;
+            default:
+                token_start_ = offset(p);
+                return scan_scalar(p, p, end);
+        }
+    }
+
+    const char* resume_token(const char* p, const char* end) {
+        if (token_ == Token::Scalar) return scan_scalar(nullptr, p, end);
+        if (escape_pending_) {
+            // The previous chunk ended on a backslash: this byte is escaped.
+            stash_ += *p;
+            escape_pending_ = false;
+            return scan_string(nullptr, p + 1, end);
+        }
+        return scan_string(nullptr, p, end);
+    }
+
+    const char* start_string(const char* quote, const char* end, bool key) {
+        key_ = key;
+        escaped_ = false;
+        token_start_ = offset(quote);
+        return scan_string(quote + 1, quote + 1, end);
+    }
+
+    // Scans string contents from `p`. `begin` is where the contents start
+    // in this chunk, or nullptr if they started in an earlier one.
+    const char* scan_string(const char* begin, const char* p, const char* end) {
+        const char* from = begin ? begin : p;
+        while (true) {
+            p = kernels::find_quote_or_backslash(p, end);
+            if (p == end) {
+                stash(begin, from, end, Token::String);
+                return end;
+            }
+            if (*p == '\\') {
+                escaped_ = true;
+                if (p + 1 == end) {
+                    stash(begin, from, end, Token::String);
+                    escape_pending_ = true;
+                    return end;
+                }
+                p += 2;
+                continue;
+            }
+            if (*p != '"') {
+                fail(ParseErrorCode::ControlCharacterInString, offset(p));
+                return end;
+            }
+            break;
+        }
+        const char* text = from;
+        if (!begin) {
+            stash_.append(from, p);
+            text = stash_.data();
+        }
+        const RawString s{text, begin ? p : text + stash_.size(), escaped_};
+        end_string(s);
+        token_ = Token::None;
+        stash_.clear();
+        return p + 1;
+    }
+
+    void end_string(const RawString& s) {
+        if (options_.validate_utf8 && !kernels::validate_utf8(s.begin, s.end)) {
+            fail(ParseErrorCode::InvalidUtf8, token_start_ + 1 + utf8_error_offset(s.begin, s.size()));
+            return;
+        }
+        if (!(key_ ? builder_.key(s) : builder_.string_value(s))) {
+            fail(ParseErrorCode::InvalidEscape, token_start_);
+            return;
+        }
+        if (key_) expect_ = Expect::Colon;
+        else value_done();
+    }
+
+    // Scans a number or literal up to the byte that ends it; see
+    // is_scalar_terminator(). `begin` is as for scan_string().
+    const char* scan_scalar(const char* begin, const char* p, const char* end) {
+        const char* from = begin ? begin : p;
+        while (p < end && !is_scalar_terminator(p, end)) ++p;
+        if (p == end) {
+            stash(begin, from, end, Token::Scalar);
+            return end;
+        }
+        if (begin) {
+            end_scalar(begin, static_cast<std::size_t>(p - begin));
+        } else {
+            stash_.append(from, p);
+            end_scalar(stash_.data(), stash_.size());
+        }
+        token_ = Token::None;
+        stash_.clear();
+        return p;
+    }
+
+    // `text` is nullptr to take the scalar from stash_.
+    void end_scalar(const char* text, std::size_t size) {
+        if (!text) {
+            text = stash_.data();
+            size = stash_.size();
+            token_ = Token::None;
+        }
+        const char* end = text + size;
+        switch (*text) {
+            case 't': case 'f': case 'n': {
+                const kernels::Literal literal = kernels::match_literal(text, end);
+                if (literal == kernels::Literal::None || size != (literal == kernels::Literal::False ? 5u : 4u)) break;
+                if (literal == kernels::Literal::Null) builder_.null_value();
+                else builder_.bool_value(literal == kernels::Literal::True);
+                value_done();
+                return;
+            }
+            default: {
+                Number num;
+                if (*text != '-' && (*text < '0' || *text > '9')) break;
+                if (parse_number(text, end, num) != end) {
+                    fail(ParseErrorCode::InvalidNumber, token_start_);
+                    return;
+                }
+                builder_.number_value(num);
+                value_done();
+                return;
+            }
+        }
+        fail(ParseErrorCode::UnrecognizedValue, token_start_);
+    }
+
+    void stash(const char* begin, const char* from, const char* end, Token token) {
+        if (begin) stash_.clear();
+        stash_.append(from, end);
+        token_ = token;
+    }
+
+    SaxBuilder<Handler> builder_;
+    ParseOptions options_;
+    std::vector<char> stack_;  // '[' or '{' for each open container
+    std::string stash_;        // a token split across chunks
+    Expect expect_ = Expect::Value;
+    Token token_ = Token::None;
+    bool key_ = false;             // the string being read is a key
+    bool escaped_ = false;         // it has a backslash
+    bool escape_pending_ = false;  // the last chunk ended on a backslash in it
+    bool failed_ = false;
+    bool paused_ = false;
+    ParseError error_{};
+    const char* chunk_ = nullptr;  // the chunk being parsed
+    std::size_t consumed_ = 0;     // bytes parsed before the chunk
+    std::size_t unread_ = 0;       // bytes of the last chunk left by pause()
+    std::size_t token_start_ = 0;  // offset of the current token
+};
+
+} // namespace custom_json
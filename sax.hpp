@@ -0,0 +1,147 @@
+#pragma once
+
+#include "stage2.hpp"
+#include <concepts>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace custom_json {
+
+// Event-driven (SAX) parsing: the grammar walker from stage2.hpp reports
+// each token to a handler and builds nothing itself. The handler is a
+// template parameter, so every call is resolved at compile time and can be
+// inlined. A handler that counts, filters or re-encodes never allocates a
+// tree; Value and Document are built by handlers of the same kind, at the
+// raw-string level stage2.hpp describes.
+//
+// Strings and keys arrive decoded. Unescaped ones are views of the input;
+// escaped ones are views of a buffer that the next string reuses, so copy
+// them to keep them. Numbers arrive in their narrowest exact
+// representation (see number.hpp).
+//
+// Events arrive in document order: on_key() precedes each member's value,
+// and a parse that fails stops at the first error, after the events for
+// whatever came before it. A handler may also throw to stop; the exception
+// propagates out of parse_sax().
+template<typename Handler>
+concept SaxHandler = requires(Handler& handler, bool b, const Number& number, std::string_view s) {
+    handler.on_null();
+    handler.on_bool(b);
+    handler.on_number(number);
+    handler.on_string(s);
+    handler.on_key(s);
+    handler.start_array();
+    handler.end_array();
+    handler.start_object();
+    handler.end_object();
+};
+
+// Adapts a SaxHandler to the Builder interface of stage2.hpp, decoding
+// strings on the way.
+template<SaxHandler Handler>
+class SaxBuilder {
+public:
+    explicit SaxBuilder(Handler& handler) : handler_(handler) {}
+
+    void null_value() { handler_.on_null(); }
+    void bool_value(bool b) { handler_.on_bool(b); }
+    void number_value(const Number& num) { handler_.on_number(num); }
+
+    bool string_value(const RawString& s) {
+        std::string_view text;
+        if (!decode(s, text)) return false;
+        handler_.on_string(text);
+        return true;
+    }
+
+    bool key(const RawString& s) {
+        std::string_view text;
+        if (!decode(s, text)) return false;
+        handler_.on_key(text);
+        return true;
+    }
+
+    void start_array() { handler_.start_array(); }
+    void end_array() { handler_.end_array(); }
+    void start_object() { handler_.start_object(); }
+    void end_object() { handler_.end_object(); }
+
+private:
+    // False on an invalid escape.
+    bool decode(const RawString& s, std::string_view& text) {
+        if (!s.escaped) {
+            text = {s.begin, s.size()};
+            return true;
+        }
+        decoded_.resize(s.size());
+        const char* end = kernels::decode_string(s.begin, s.end, decoded_.data());
+        if (!end) return false;
+        text = {decoded_.data(), static_cast<std::size_t>(end - decoded_.data())};
+        return true;
+    }
+
+    Handler& handler_;
+    std::string decoded_;
+};
+
+// Parses `json`, reporting each token to `handler`. Malformed input is
+// reported through the returned error, as by try_parse().
+template<SaxHandler Handler>
+std::expected<void, ParseError> parse_sax(std::string_view json, Handler& handler, const ParseOptions& options = {}) {
+    SaxBuilder<Handler> builder(handler);
+    return run_parser(json, options, builder);
+}
+
+// Builds a Value from events, for sources that have no builder of their
+// own, such as PushParser. Values use the default memory resource; take()
+// hands over the finished tree.
+class ValueHandler {
+public:
+    void on_null() { add(Value()); }
+    void on_bool(bool b) { add(Value(b)); }
+    void on_number(const Number& num) {
+        switch (num.kind) {
+            case Number::Kind::Int64: add(Value(num.i)); break;
+            case Number::Kind::UInt64: add(Value(num.u)); break;
+            default: add(Value(num.d)); break;
+        }
+    }
+    void on_string(std::string_view s) { add(Value(s)); }
+    void on_key(std::string_view s) { stack_.back().key.assign(s); }
+
+    void start_array() { stack_.emplace_back().is_object = false; }
+    void start_object() { stack_.emplace_back().is_object = true; }
+    void end_array() { end_container(Value(std::move(stack_.back().array))); }
+    void end_object() { end_container(Value(std::move(stack_.back().object))); }
+
+    Value take() { return std::move(root_); }
+
+private:
+    struct Frame {
+        bool is_object;
+        Value::Array array;
+        Value::Object object;
+        std::string key;  // of the member whose value comes next
+    };
+
+    void add(Value&& value) {
+        if (stack_.empty()) {
+            root_ = std::move(value);
+        } else if (Frame& top = stack_.back(); top.is_object) {
+            top.object.insert_or_assign(top.key, std::move(value));
+        } else {
+            top.array.push_back(std::move(value));
+        }
+    }
+
+    void end_container(Value&& value) {
+        stack_.pop_back();
+        add(std::move(value));
+    }
+
+    std::vector<Frame> stack_;
+    Value root_;
+};
+
+} // namespace custom_json
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "json_parser.hpp"
+#include "structural_index.hpp"
+#include "kernels.hpp"
+#include "number.hpp"
+#include "utf8.hpp"
+#include <cstring>
+#include <expected>
+#include <string_view>
+
+namespace custom_json {
+
+// Stage 2 of the parser: the JSON grammar, written once and templated on
+// where tokens come from (a Cursor) and what is built from them (a Builder).
+// Builders receive one call per token:
+//
+//   void null_value(); void bool_value(bool); void number_value(const Number&);
+//   bool string_value(const RawString&); bool key(const RawString&);
+//   void start_array(); void end_array(); void start_object(); void end_object();
+//
+// string_value() and key() return false if the string has an invalid escape.
+// json_parser.cpp builds a Value and document.cpp a tape; sax.hpp adapts
+// the interface for handlers that want decoded strings.
+
+// Below this size building the structural index costs more than it saves,
+// so small documents are parsed directly from the bytes.
+inline constexpr std::size_t kStructuralIndexThreshold = 4096;
+
+// The contents of a string token, between its quotes and still escaped.
+struct RawString {
+    const char* begin;
+    const char* end;
+    bool escaped;  // contains at least one backslash
+
+    std::size_t size() const { return static_cast<std::size_t>(end - begin); }
+};
+
+// Writes the decoded contents of `s` to `out`, which needs room for
+// s.size() bytes. Returns one past the last byte written, or nullptr on an
+// invalid escape.
+inline char* decode_raw_string(const RawString& s, char* out) {
+    if (!s.escaped) {
+        std::memcpy(out, s.begin, s.size());
+        return out + s.size();
+    }
+    return kernels::decode_string(s.begin, s.end, out);
+}
+
+inline const char* skip_whitespace(const char*& start, const char* end) {
+    // Most gaps between tokens are empty or a single space; only longer runs
+    // (newline plus indentation) are worth a call into the vector kernel.
+    if (start < end && kernels::is_whitespace(*start)) {
+        ++start;
+        if (start < end && kernels::is_whitespace(*start)) {
+            start = kernels::skip_whitespace(start + 1, end);
+        }
+    }
+    return start;
+}
+
+// Remembers the first error stage 2 runs into. Parse functions report it by
+// returning fail(), which is false, and every caller passes that straight up.
+class ErrorSlot {
+public:
+    bool fail(ParseErrorCode code, const char* at) {
+        code_ = code;
+        at_ = at;
+        return false;
+    }
+    ParseErrorCode code() const { return code_; }
+    const char* at() const { return at_; }
+
+private:
+    ParseErrorCode code_ = ParseErrorCode::UnexpectedEnd;
+    const char* at_ = nullptr;
+};
+
+// Stage-2 cursors. `token()` returns the start of the next token (or `end()`
+// when the input is exhausted) and `consume()` moves past it; `after` is the
+// first byte following the token just parsed.
+
+// Walks the raw bytes, skipping whitespace between tokens. Strings are
+// checked for valid UTF-8 as they are parsed, if asked for.
+class ByteCursor : public ErrorSlot {
+public:
+    ByteCursor(const char* start, const char* end, bool validate_utf8)
+        : pos_(start), end_(end), validate_utf8_(validate_utf8) {}
+
+    const char* token() { return skip_whitespace(pos_, end_); }
+    char peek() { const char* t = token(); return t < end_ ? *t : '\0'; }
+    void consume(const char* after) { pos_ = after; }
+    const char* end() const { return end_; }
+    bool validate_utf8() const { return validate_utf8_; }
+
+private:
+    const char* pos_;
+    const char* end_;
+    bool validate_utf8_;
+};
+
+// Walks the offsets recorded by stage 1, so whitespace is never looked at.
+// Stage 1 has already validated UTF-8 if that was asked for.
+class IndexCursor : public ErrorSlot {
+public:
+    IndexCursor(const char* data, const char* end, const StructuralIndex& index)
+        : data_(data), end_(end), next_(index.begin()), last_(index.end()) {}
+
+    const char* token() const { return next_ < last_ ? data_ + *next_ : end_; }
+    char peek() const { return next_ < last_ ? data_[*next_] : '\0'; }
+    void consume(const char*) { ++next_; }
+    const char* end() const { return end_; }
+    bool validate_utf8() const { return false; }
+
+private:
+    const char* data_;
+    const char* end_;
+    const uint32_t* next_;
+    const uint32_t* last_;
+};
+
+// Bare scalars must be followed by whitespace, a structural character or the
+// end of input; stage 1 does not index the bytes in "truex" or "12abc".
+inline bool is_scalar_terminator(const char* p, const char* end) {
+    if (p >= end) return true;
+    switch (*p) {
+        case ' ': case '\t': case '\n': case '\r':
+        case ',': case ':': case ']': case '}': case '[': case '{':
+            return true;
+        default:
+            return false;
+    }
+}
+
+template<typename Cursor, typename Builder>
+bool parse_array(Cursor& cur, Builder& builder);
+template<typename Cursor, typename Builder>
+bool parse_object(Cursor& cur, Builder& builder);
+
+// Finds the end of the string whose opening quote is at `start` and leaves
+// `start` just past the closing quote.
+template<typename Cursor>
+bool scan_string(Cursor& cur, const char*& start, RawString& out) {
+    const char* end = cur.end();
+    const char* open = start;
+    ++start; // Skip opening quote
+    const char* stop = kernels::find_quote_or_backslash(start, end);
+    bool escaped = false;
+    if (stop < end && *stop == '\\') {
+        // The first backslash is unescaped, so the block scanner can resolve
+        // backslash runs from here to the closing quote.
+        stop = kernels::find_string_end(stop, end);
+        escaped = true;
+    }
+    if (stop < end && *stop == '"') {
+        if (cur.validate_utf8() && !kernels::validate_utf8(start, stop)) {
+            return cur.fail(ParseErrorCode::InvalidUtf8, start + utf8_error_offset(start, static_cast<std::size_t>(stop - start)));
+        }
+        out = {start, stop, escaped};
+        start = stop + 1; // Skip closing quote
+        return true;
+    }
+    if (stop < end) return cur.fail(ParseErrorCode::ControlCharacterInString, stop);
+    return cur.fail(ParseErrorCode::UnterminatedString, open);
+}
+
+template<typename Cursor, typename Builder>
+bool parse_value(Cursor& cur, Builder& builder) {
+    const char* start = cur.token();  // Positioned on the first byte of the value
+    const char* end = cur.end();
+
+    if (start >= end) {
+        return cur.fail(ParseErrorCode::UnexpectedEnd, end);
+    }
+
+    switch (*start) {
+        case 'n':  // Parse `null`
+        case 't':  // Parse `true`
+        case 'f': {  // Parse `false`
+            const kernels::Literal literal = kernels::match_literal(start, end);
+            const char* after = start + (literal == kernels::Literal::False ? 5 : 4);
+            if (literal == kernels::Literal::None || !is_scalar_terminator(after, end)) break;
+            cur.consume(after);
+            if (literal == kernels::Literal::Null) builder.null_value();
+            else builder.bool_value(literal == kernels::Literal::True);
+            return true;
+        }
+        case '"': {  // Parse string
+            RawString str;
+            if (!scan_string(cur, start, str)) return false;
+            if (!builder.string_value(str)) return cur.fail(ParseErrorCode::InvalidEscape, str.begin - 1);
+            cur.consume(start);
+            return true;
+        }
+        case '[':  // Parse array
+            return parse_array(cur, builder);
+        case '{':  // Parse object
+            return parse_object(cur, builder);
+        case '-':  // Parse number (negative)
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9': {  // Parse number
+            Number num;
+            const char* num_end = custom_json::parse_number(start, end, num);
+            if (!num_end || !is_scalar_terminator(num_end, end)) return cur.fail(ParseErrorCode::InvalidNumber, start);
+            builder.number_value(num);
+            cur.consume(num_end);
+            return true;
+        }
+        default:
+            break;
+    }
+
+    return cur.fail(ParseErrorCode::UnrecognizedValue, start);
+}
+
+template<typename Cursor, typename Builder>
+bool parse_array(Cursor& cur, Builder& builder) {
+    builder.start_array();
+    cur.consume(cur.token() + 1); // Skip opening bracket
+
+    if (cur.peek() != ']') {
+        do {
+            if (!parse_value(cur, builder)) return false;
+        } while (cur.peek() == ',' && (cur.consume(cur.token() + 1), true));
+
+        if (cur.peek() != ']') return cur.fail(ParseErrorCode::ExpectedArrayEnd, cur.token());
+    }
+
+    cur.consume(cur.token() + 1); // Skip closing bracket
+    builder.end_array();
+    return true;
+}
+
+template<typename Cursor, typename Builder>
+bool parse_object(Cursor& cur, Builder& builder) {
+    builder.start_object();
+    cur.consume(cur.token() + 1);  // Skip the opening brace '{'
+
+    if (cur.peek() != '}') {  // If the object is not immediately closed
+        do {
+            // Every member starts with a string key
+            if (cur.peek() != '"') return cur.fail(ParseErrorCode::ExpectedKey, cur.token());
+
+            // Parse the string key
+            const char* start = cur.token();
+            RawString key;
+            if (!scan_string(cur, start, key)) return false;
+            if (!builder.key(key)) return cur.fail(ParseErrorCode::InvalidEscape, key.begin - 1);
+            cur.consume(start);
+
+            // Ensure the colon ':' follows the key
+            if (cur.peek() != ':') return cur.fail(ParseErrorCode::ExpectedColon, cur.token());
+
+            cur.consume(cur.token() + 1);  // Skip the colon
+
+            // Parse the associated value
+            if (!parse_value(cur, builder)) return false;
+
+            // Check for a comma or closing brace
+        } while (cur.peek() == ',' && (cur.consume(cur.token() + 1), true));  // Move to the next key-value pair if a comma is present
+
+        // Ensure the object is properly closed
+        if (cur.peek() != '}') return cur.fail(ParseErrorCode::ExpectedObjectEnd, cur.token());
+    }
+
+    cur.consume(cur.token() + 1);  // Skip the closing brace '}'
+    builder.end_object();
+    return true;
+}
+
+template<typename Cursor, typename Builder>
+std::expected<void, ParseError> parse_root(Cursor& cur, Builder& builder, const char* data) {
+    if (parse_value(cur, builder)) {
+        if (cur.token() == cur.end()) return {};
+        cur.fail(ParseErrorCode::TrailingCharacters, cur.token());
+    }
+    return std::unexpected(ParseError{cur.code(), static_cast<std::size_t>(cur.at() - data)});
+}
+
+// Runs both stages over `json`, feeding `builder`. Small documents skip
+// stage 1 and are parsed straight from the bytes. Large ones are indexed
+// into `index`, whose buffer is reused if it is big enough.
+template<typename Builder>
+std::expected<void, ParseError> run_parser(std::string_view json, const ParseOptions& options, Builder& builder,
+                                           StructuralIndex& index) {
+    const char* start = json.data();
+    const char* end = start + json.size();
+    if (json.size() < kStructuralIndexThreshold) {
+        ByteCursor cur(start, end, options.validate_utf8);
+        return parse_root(cur, builder, start);
+    }
+    if (auto built = index.build(start, json.size(), options.validate_utf8); !built) {  // Stage 1
+        return built;
+    }
+    IndexCursor cur(start, end, index);
+    return parse_root(cur, builder, start);  // Stage 2
+}
+
+template<typename Builder>
+std::expected<void, ParseError> run_parser(std::string_view json, const ParseOptions& options, Builder& builder) {
+    StructuralIndex index;
+    return run_parser(json, options, builder, index);
+}
+
+} // namespace custom_json
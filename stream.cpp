@@ -0,0 +1,238 @@
+#include "stream.hpp"
+#include "push_parser.hpp"
+#include <functional>
+#include <istream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace custom_json {
+
+static constexpr std::size_t kStreamChunkSize = 64 * 1024;
+
+// One reference token of a JSON Pointer.
+struct PointerToken {
+    std::string key;
+    std::size_t index;  // as an array index, or npos if it is not one
+};
+
+// Splits a JSON Pointer into its tokens, undoing the ~0 and ~1 escapes.
+static std::vector<PointerToken> parse_pointer(std::string_view pointer) {
+    if (!pointer.empty() && pointer.front() != '/') throw std::invalid_argument("JSON Pointer must start with '/'");
+    std::vector<PointerToken> tokens;
+    while (!pointer.empty()) {
+        pointer.remove_prefix(1);
+        const std::string_view raw = pointer.substr(0, pointer.find('/'));
+        pointer.remove_prefix(raw.size());
+
+        PointerToken& token = tokens.emplace_back();
+        for (std::size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] != '~') {
+                token.key += raw[i];
+            } else if (i + 1 < raw.size() && (raw[i + 1] == '0' || raw[i + 1] == '1')) {
+                token.key += raw[++i] == '0' ? '~' : '/';
+            } else {
+                throw std::invalid_argument("Invalid escape in JSON Pointer");
+            }
+        }
+        // Array indices are decimal without leading zeros.
+        token.index = std::string::npos;
+        const bool digits = !token.key.empty() && token.key.find_first_not_of("0123456789") == std::string::npos;
+        if (digits && (token.key.size() == 1 || token.key[0] != '0') && token.key.size() < 20) {
+            token.index = std::stoull(token.key);
+        }
+    }
+    return tokens;
+}
+
+// A handler that follows the events down a pointer's path and builds each
+// element of the array it leads to. It leaves each finished element in
+// `ready` and calls `pause`, so the parser stops there until the element
+// has been consumed; it pauses again once the array closes. Everything off
+// the path is only counted.
+class ArrayStreamer {
+public:
+    ArrayStreamer(const std::vector<PointerToken>& path, std::optional<Value>& ready, std::function<void()> pause)
+        : path_(path), ready_(ready), pause_(std::move(pause)) {}
+
+    bool found() const { return found_; }
+    bool done() const { return done_; }
+
+    void on_null() { scalar([&] { element_.on_null(); }); }
+    void on_bool(bool b) { scalar([&] { element_.on_bool(b); }); }
+    void on_number(const Number& num) { scalar([&] { element_.on_number(num); }); }
+    void on_string(std::string_view s) { scalar([&] { element_.on_string(s); }); }
+
+    void on_key(std::string_view key) {
+        if (depth_ > 0) {
+            element_.on_key(key);
+        } else if (Level& top = levels_.back(); top.on_path) {
+            top.key_matches = path_[levels_.size() - 1].key == key;
+        }
+    }
+
+    void start_array() { open(true, [&] { element_.start_array(); }); }
+    void start_object() { open(false, [&] { element_.start_object(); }); }
+    void end_array() { close([&] { element_.end_array(); }); }
+    void end_object() { close([&] { element_.end_object(); }); }
+
+private:
+    // Where a value that is starting lies relative to the path.
+    enum class Place { Off, OnPath, Target, Element };
+
+    struct Level {
+        bool is_array;
+        bool on_path;            // the path runs through this container
+        bool target;             // it is the array being streamed
+        bool key_matches;        // the current member's key is the path's next token
+        std::size_t index = 0;   // of the current element, in an array
+    };
+
+    Place place() const {
+        if (done_) return Place::Off;
+        if (levels_.empty()) return path_.empty() ? Place::Target : Place::OnPath;
+        const Level& top = levels_.back();
+        if (top.target) return Place::Element;
+        if (!top.on_path) return Place::Off;
+        const bool match = top.is_array ? path_[levels_.size() - 1].index == top.index : top.key_matches;
+        if (!match) return Place::Off;
+        return levels_.size() == path_.size() ? Place::Target : Place::OnPath;
+    }
+
+    // Counts a finished value in the array around it.
+    void next() {
+        if (!levels_.empty()) ++levels_.back().index;
+    }
+
+    template<typename Emit>
+    void scalar(Emit emit) {
+        if (depth_ > 0) {
+            emit();
+            return;
+        }
+        switch (place()) {
+            case Place::Target:
+                throw std::runtime_error("Value is not an array");
+            case Place::Element:
+                emit();
+                finish_element();
+                break;
+            default:
+                break;
+        }
+        next();
+    }
+
+    template<typename Emit>
+    void open(bool is_array, Emit emit) {
+        if (depth_ > 0) {
+            ++depth_;
+            emit();
+            return;
+        }
+        const Place where = place();
+        if (where == Place::Element) {
+            depth_ = 1;
+            emit();
+            return;
+        }
+        if (where == Place::Target) {
+            if (!is_array) throw std::runtime_error("Value is not an array");
+            found_ = true;
+        }
+        levels_.push_back({is_array, where != Place::Off, where == Place::Target, false});
+    }
+
+    template<typename Emit>
+    void close(Emit emit) {
+        if (depth_ > 0) {
+            emit();
+            if (--depth_ == 0) {
+                finish_element();
+                next();
+            }
+            return;
+        }
+        if (levels_.back().target) {
+            done_ = true;
+            pause_();
+        }
+        levels_.pop_back();
+        next();
+    }
+
+    void finish_element() {
+        ready_ = element_.take();
+        pause_();
+    }
+
+    const std::vector<PointerToken>& path_;
+    std::optional<Value>& ready_;
+    std::function<void()> pause_;
+    std::vector<Level> levels_;  // the containers open around the current value
+    ValueHandler element_;       // builds the current element
+    std::size_t depth_ = 0;      // containers open within the current element
+    bool found_ = false;
+    bool done_ = false;
+};
+
+[[noreturn]] static void fail_stream(const ParseError& error, const std::istream* in, std::string_view json) {
+    if (!in) throw_parse_error(error, json);
+    throw std::runtime_error(std::string("JSON parse error: ") + to_string(error.code) + " at byte " +
+                             std::to_string(error.offset));
+}
+
+// Reads from `in` if it is set and from `json` otherwise.
+static Generator<Value> stream_elements(std::istream* in, std::string_view json, std::vector<PointerToken> path,
+                                        std::string pointer, ParseOptions options) {
+    std::optional<Value> element;
+    PushParser<ArrayStreamer>* pausing = nullptr;
+    ArrayStreamer streamer(path, element, [&pausing] { pausing->pause(); });
+    PushParser<ArrayStreamer> parser(streamer, options);
+    pausing = &parser;
+    std::vector<char> buffer(in ? kStreamChunkSize : 0);
+    std::size_t offset = 0;
+
+    bool end_of_input = false;
+    while (!streamer.done() && !end_of_input) {
+        std::span<const char> chunk;
+        if (in) {
+            in->read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            chunk = {buffer.data(), static_cast<std::size_t>(in->gcount())};
+        } else {
+            chunk = json.substr(offset, kStreamChunkSize);
+            offset += chunk.size();
+        }
+        end_of_input = chunk.empty();
+
+        // The parser pauses after each element, which is yielded before the
+        // rest of the chunk is fed, so only one is built at a time.
+        do {
+            std::optional<ParseError> error;
+            if (end_of_input) {
+                if (auto finished = parser.finish(); !finished) error = finished.error();
+            } else if (auto fed = parser.feed(chunk); !fed) {
+                error = fed.error();
+            } else {
+                chunk = chunk.last(parser.unread());
+            }
+            if (element) {
+                co_yield *element;
+                element.reset();
+            }
+            if (error) fail_stream(*error, in, json);
+        } while (!chunk.empty() && !streamer.done());
+    }
+    if (!streamer.found()) throw std::out_of_range("No value at " + pointer);
+}
+
+Generator<Value> stream_array(std::istream& in, std::string_view pointer, const ParseOptions& options) {
+    return stream_elements(&in, {}, parse_pointer(pointer), std::string(pointer), options);
+}
+
+Generator<Value> stream_array(std::string_view json, std::string_view pointer, const ParseOptions& options) {
+    return stream_elements(nullptr, json, parse_pointer(pointer), std::string(pointer), options);
+}
+
+} // namespace custom_json
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "json_parser.hpp"
+#include <coroutine>
+#include <exception>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace custom_json {
+
+// A sequence produced on demand by a coroutine, in the manner of C++23's
+// std::generator, which this standard library does not provide yet. The
+// coroutine runs up to each co_yield as the iterator is advanced, and the
+// iterator refers to the yielded object until the next advance; an
+// exception thrown in the coroutine propagates out of begin() or ++.
+// Single pass and move-only.
+template<typename T>
+class Generator {
+public:
+    struct promise_type {
+        T* current = nullptr;
+        std::exception_ptr exception;
+
+        Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T& value) noexcept {
+            current = std::addressof(value);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    class iterator {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        // The element may be moved from.
+        T& operator*() const { return *handle_.promise().current; }
+        iterator& operator++() {
+            resume(handle_);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return handle_.done(); }
+
+    private:
+        friend class Generator;
+        explicit iterator(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Generator& operator=(Generator&& other) noexcept {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    ~Generator() {
+        if (handle_) handle_.destroy();
+    }
+
+    iterator begin() {
+        resume(handle_);
+        return iterator(handle_);
+    }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    explicit Generator(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    static void resume(std::coroutine_handle<promise_type> handle) {
+        handle.resume();
+        if (handle.promise().exception) std::rethrow_exception(std::exchange(handle.promise().exception, nullptr));
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Streams the elements of the array at `pointer`, a JSON Pointer
+// (RFC 6901) such as "/reviews" or "/data/0/items", one at a time:
+//
+//   for (Value& review : stream_array(file, "/reviews")) process(review);
+//
+// The input is read in chunks and fed to a PushParser, which pauses after
+// each element so that it is yielded before the next one is built: only
+// the current chunk and one element are held at once. The rest of the
+// document is followed but never built, and reading stops once the array
+// closes. Peak memory is therefore bounded by the largest element,
+// not by the array or the document. The chunk buffer and the builder's
+// stack are reused from one element to the next.
+//
+// An invalid pointer throws std::invalid_argument here. While iterating,
+// malformed input throws std::runtime_error. It names the line and column
+// for text in memory and the byte offset for a stream. A pointer that
+// leads nowhere throws std::out_of_range, and one that leads to something
+// other than an array throws std::runtime_error. The stream, or the text,
+// must outlive the generator.
+Generator<Value> stream_array(std::istream& in, std::string_view pointer, const ParseOptions& options = {});
+Generator<Value> stream_array(std::string_view json, std::string_view pointer, const ParseOptions& options = {});
+
+} // namespace custom_json
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include "json_parser.hpp"
+
+// Measures the Value tree on two string workloads that stress different
+// storage paths: a key-heavy document of short keys and enum-like values,
+// which should fit inline, and a long-text document whose strings all spill.
+// The directory's own documents are reported alongside for reference.
+
+namespace fs = std::filesystem;
+
+// Counts what the tree asks of the heap.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    std::size_t allocations = 0;
+    std::size_t bytes = 0;
+
+private:
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        ++allocations;
+        bytes += size;
+        return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+    void do_deallocate(void* p, std::size_t size, std::size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+static std::string key_heavy_document() {
+    static const char* const statuses[] = {"active", "inactive", "pending", "archived"};
+    std::string json = "[";
+    for (int i = 0; i < 20000; ++i) {
+        if (i) json += ',';
+        json += "{\"id\":" + std::to_string(i) + ",\"status\":\"" + statuses[i % 4] + "\",\"dept\":\"Department_" +
+                std::to_string(i % 7) + "\",\"since\":\"2024-03-" + std::to_string(10 + i % 18) +
+                "\",\"code\":\"X" + std::to_string(i % 100) + "\",\"flag\":" + (i % 2 ? "true" : "false") + "}";
+    }
+    return json + "]";
+}
+
+static std::string long_text_document() {
+    const std::string sentence = "The quick brown fox jumps over the lazy dog while the parser keeps count. ";
+    std::string json = "[";
+    for (int i = 0; i < 2000; ++i) {
+        if (i) json += ',';
+        std::string text;
+        for (int j = 0; j < 4 + i % 8; ++j) text += sentence;
+        json += "{\"title\":\"Entry " + std::to_string(i) + " of the long text benchmark\",\"body\":\"" + text + "\"}";
+    }
+    return json + "]";
+}
+
+static void report(const std::string& name, const std::string& json) {
+    constexpr int rounds = 50;
+    CountingResource counter;
+    std::pmr::memory_resource* previous = std::pmr::set_default_resource(&counter);
+    std::chrono::duration<double> duration{};
+    for (int i = 0; i < rounds; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        custom_json::Value result = custom_json::parse(json);
+        duration += std::chrono::high_resolution_clock::now() - start;
+    }
+    std::pmr::set_default_resource(previous);
+
+    const double input = static_cast<double>(json.size()) * rounds;
+    std::cout << name << ": " << input / duration.count() / 1e6 << " MB/s, "
+              << static_cast<double>(counter.allocations) / rounds << " allocations, "
+              << static_cast<double>(counter.bytes) / input << " bytes per input byte" << std::endl;
+}
+
+void benchmark_strings(const std::string& directory_path) {
+    std::string corpus = "[";
+    for (const auto& entry : fs::directory_iterator(directory_path)) {
+        if (entry.path().extension() == ".json") {
+            std::ifstream file(entry.path());
+            const std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (!custom_json::try_parse(json)) continue;  // keeps one bad file from sinking the corpus
+            if (corpus.size() > 1) corpus += ',';
+            corpus += json;
+        }
+    }
+    corpus += "]";
+
+    report("key-heavy", key_heavy_document());
+    report("long-text", long_text_document());
+    report("corpus", corpus);
+}
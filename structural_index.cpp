@@ -0,0 +1,244 @@
+#include "structural_index.hpp"
+#include "bitmask.hpp"
+#include "kernels.hpp"
+#include "utf8.hpp"
+#include <cstring>
+#include <limits>
+#include <immintrin.h>
+
+namespace custom_json {
+
+namespace {
+
+// Per-byte classification of one 64-byte block; bit i describes byte i.
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t whitespace;
+    uint64_t op;
+};
+
+// One struct per SimdLevel providing classify(), prefix_xor() and the UTF-8
+// checker to use. Their member functions carry target attributes and are
+// only ever inlined into the matching index_structurals_* entry point below.
+
+struct ScalarIsa {
+    using Utf8Checker = Utf8ScalarChecker;
+
+    static BlockMasks classify(const char* block) {
+        BlockMasks m{0, 0, 0, 0};
+        for (int i = 0; i < 64; ++i) {
+            const uint64_t bit = uint64_t(1) << i;
+            switch (block[i]) {
+                case '"':  m.quote |= bit; break;
+                case '\\': m.backslash |= bit; break;
+                case ' ': case '\t': case '\n': case '\r': m.whitespace |= bit; break;
+                case '{': case '}': case '[': case ']': case ':': case ',': m.op |= bit; break;
+                default: break;
+            }
+        }
+        return m;
+    }
+
+    // Bit i of the result is the xor of bits 0..i of the input, which turns a
+    // mask of quote positions into a mask of "inside a string" positions.
+    static uint64_t prefix_xor(uint64_t bits) {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+};
+
+struct Sse2Isa {
+    using Utf8Checker = Utf8ScalarChecker;
+
+    __attribute__((target("sse2")))
+    static BlockMasks classify(const char* block) {
+        BlockMasks m{0, 0, 0, 0};
+        for (int q = 0; q < 4; ++q) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * q));
+            const __m128i lowered = _mm_or_si128(chunk, _mm_set1_epi8(0x20));  // '[' -> '{', ']' -> '}'
+            const __m128i ws = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+            const __m128i op = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(lowered, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lowered, _mm_set1_epi8('}'))),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(',')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(':'))));
+            const int shift = 16 * q;
+            m.quote |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))))) << shift;
+            m.backslash |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))))) << shift;
+            m.whitespace |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(ws))) << shift;
+            m.op |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(op))) << shift;
+        }
+        return m;
+    }
+
+    static uint64_t prefix_xor(uint64_t bits) {
+        return ScalarIsa::prefix_xor(bits);
+    }
+};
+
+struct Avx2Isa {
+    using Utf8Checker = Utf8Avx2Checker;
+
+    __attribute__((target("avx2")))
+    static BlockMasks classify(const char* block) {
+        BlockMasks m{0, 0, 0, 0};
+        for (int h = 0; h < 2; ++h) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * h));
+            const __m256i lowered = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));  // '[' -> '{', ']' -> '}'
+            const __m256i ws = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+            const __m256i op = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(lowered, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(lowered, _mm256_set1_epi8('}'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(',')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':'))));
+            const int shift = 32 * h;
+            m.quote |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'))))) << shift;
+            m.backslash |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))))) << shift;
+            m.whitespace |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(ws))) << shift;
+            m.op |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(op))) << shift;
+        }
+        return m;
+    }
+
+    // Carry-less multiplication by all ones computes the prefix xor in one instruction.
+    __attribute__((target("pclmul")))
+    static uint64_t prefix_xor(uint64_t bits) {
+        const __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<long long>(bits)), _mm_set1_epi8(-1), 0);
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(product));
+    }
+};
+
+struct Avx512Isa {
+    using Utf8Checker = Utf8Avx2Checker;
+
+    __attribute__((target("avx512f,avx512bw")))
+    static BlockMasks classify(const char* block) {
+        const __m512i chunk = _mm512_loadu_si512(block);
+        const __m512i lowered = _mm512_or_si512(chunk, _mm512_set1_epi8(0x20));  // '[' -> '{', ']' -> '}'
+        return {
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('"')),
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\\')),
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(' ')) | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\t')) |
+                _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\n')) | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\r')),
+            _mm512_cmpeq_epi8_mask(lowered, _mm512_set1_epi8('{')) | _mm512_cmpeq_epi8_mask(lowered, _mm512_set1_epi8('}')) |
+                _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(',')) | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(':')),
+        };
+    }
+
+    static uint64_t prefix_xor(uint64_t bits) {
+        return Avx2Isa::prefix_xor(bits);
+    }
+};
+
+} // namespace
+
+// The block loop shared by every variant. Each index_structurals_* entry
+// point is compiled with `flatten`, so this and the Isa member functions are
+// inlined into code generated for that instruction set. UTF-8 is checked on
+// the block just classified, while it is still in L1.
+template<typename Isa, bool ValidateUtf8>
+static kernels::IndexResult index_blocks(const char* data, std::size_t length, uint32_t* out) {
+    typename Isa::Utf8Checker utf8;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;  // all ones while a string spans the block boundary
+    uint64_t prev_scalar = 0;
+
+    char tail[64];
+    for (std::size_t base = 0; base < length; base += 64) {
+        const char* block = data + base;
+        if (length - base < 64) {
+            // Pad the final partial block with whitespace so it classifies as nothing.
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, block, length - base);
+            block = tail;
+        }
+
+        const BlockMasks m = Isa::classify(block);
+        if constexpr (ValidateUtf8) utf8.check_block(block);
+
+        const uint64_t quote = m.quote & ~escaped_characters(m.backslash, prev_escaped);
+        const uint64_t in_string = Isa::prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+        // A scalar starts at any non-whitespace, non-operator byte that does not
+        // directly follow another such byte. Quotes are excluded from the
+        // "follows" test so that garbage right after a string still gets indexed.
+        const uint64_t scalar = ~(m.op | m.whitespace);
+        const uint64_t nonquote_scalar = scalar & ~quote;
+        const uint64_t follows_scalar = (nonquote_scalar << 1) | prev_scalar;
+        prev_scalar = nonquote_scalar >> 63;
+        const uint64_t scalar_start = scalar & ~follows_scalar;
+
+        // Everything inside a string, including its closing quote, is dropped.
+        const uint64_t string_tail = in_string ^ quote;
+        uint64_t structurals = (m.op | scalar_start) & ~string_tail;
+
+        while (structurals) {
+            *out++ = static_cast<uint32_t>(base + static_cast<std::size_t>(__builtin_ctzll(structurals)));
+            structurals &= structurals - 1;
+        }
+    }
+
+    return {out, prev_in_string != 0, ValidateUtf8 && !utf8.valid()};
+}
+
+template<typename Isa>
+static kernels::IndexResult index_blocks(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    return validate_utf8 ? index_blocks<Isa, true>(data, length, out) : index_blocks<Isa, false>(data, length, out);
+}
+
+namespace kernels {
+
+IndexResult index_structurals_scalar(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    return index_blocks<ScalarIsa>(data, length, out, validate_utf8);
+}
+
+__attribute__((target("sse2"), flatten))
+IndexResult index_structurals_sse2(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    return index_blocks<Sse2Isa>(data, length, out, validate_utf8);
+}
+
+__attribute__((target("avx2,pclmul"), flatten))
+IndexResult index_structurals_avx2(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    return index_blocks<Avx2Isa>(data, length, out, validate_utf8);
+}
+
+__attribute__((target("avx512f,avx512bw,avx2,pclmul"), flatten))
+IndexResult index_structurals_avx512(const char* data, std::size_t length, uint32_t* out, bool validate_utf8) {
+    return index_blocks<Avx512Isa>(data, length, out, validate_utf8);
+}
+
+} // namespace kernels
+
+std::expected<void, ParseError> StructuralIndex::build(const char* data, std::size_t length, bool validate_utf8) {
+    if (length > std::numeric_limits<uint32_t>::max()) {
+        return std::unexpected(ParseError{ParseErrorCode::DocumentTooLarge, std::numeric_limits<uint32_t>::max()});
+    }
+
+    // Worst case every byte is structural. The buffer is left uninitialised
+    // and only grows, so a reused index does not pay for it again.
+    if (capacity_ < length) {
+        positions_ = std::make_unique_for_overwrite<uint32_t[]>(length);
+        capacity_ = length;
+    }
+
+    const kernels::IndexResult result = kernels::index_structurals(data, length, positions_.get(), validate_utf8);
+    count_ = static_cast<std::size_t>(result.last - positions_.get());
+    if (result.invalid_utf8) {
+        // The block checkers only say whether something was wrong; find where.
+        return std::unexpected(ParseError{ParseErrorCode::InvalidUtf8, utf8_error_offset(data, length)});
+    }
+    if (result.unterminated) {
+        // Everything after the opening quote is string contents, so it is the last entry.
+        return std::unexpected(ParseError{ParseErrorCode::UnterminatedString, count_ ? result.last[-1] : 0});
+    }
+    return {};
+}
+
+} // namespace custom_json
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "parse_error.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+
+namespace custom_json {
+
+// Stage 1 of the parser: classifies the input 64 bytes at a time and records
+// the offset of every structural character ({}[]:,), every opening quote and
+// the first byte of every bare scalar (numbers, true, false, null).
+// Whitespace and string contents never appear in the index, so stage 2 can
+// jump straight from one token to the next.
+class StructuralIndex {
+public:
+    // Fails if the input ends inside a string or, with `validate_utf8` set,
+    // is not well-formed UTF-8.
+    std::expected<void, ParseError> build(const char* data, std::size_t length, bool validate_utf8 = false);
+
+    const uint32_t* begin() const { return positions_.get(); }
+    const uint32_t* end() const { return positions_.get() + count_; }
+    std::size_t size() const { return count_; }
+
+private:
+    std::unique_ptr<uint32_t[]> positions_;
+    std::size_t capacity_ = 0;
+    std::size_t count_ = 0;
+};
+
+} // namespace custom_json
@@ -1,12 +1,35 @@
 #define CATCH_CONFIG_MAIN
 #include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
 #include <filesystem>  // C++17 feature for file system operations
+#include <functional>
+#include <string>
+#include <vector>
 
 #include "catch.hpp"  // Include the Catch2 header
 #include "nhomann/json.hpp"  // Include your JSON library
+#include "json_parser.hpp"
+#include "document.hpp"
+#include "lazy.hpp"
+#include "ndjson.hpp"
+#include "push_parser.hpp"
+#include "sax.hpp"
+#include "stream.hpp"
+#include "kernels.hpp"
 
 namespace fs = std::filesystem;
 
+namespace custom_json {
+// Reads a Document's key table, which is not part of its interface.
+struct DocumentTestAccess {
+    static std::size_t key_count(const Document& doc) { return doc.keys_.size(); }
+    static std::size_t key_slots(const Document& doc) { return doc.keys_.slots(); }
+    static std::size_t key_probes(const Document& doc) { return doc.key_probes_; }
+};
+} // namespace custom_json
+
 // Helper function to test each JSON file
 void test_json_file(const std::string& file_path) {
     std::ifstream json_file(file_path);
@@ -38,3 +61,1120 @@ TEST_CASE("Test all JSON files in ./test-json folder") {
     }
 }
 
+// Leading whitespace takes a document past kStructuralIndexThreshold, so
+// stage 2 walks stage 1's index instead of the bytes; the result must not
+// change.
+TEST_CASE("Large documents take the structural index and agree with the byte path") {
+    const std::string pad(4096, ' ');
+
+    // Escaped quotes and backslash runs at every alignment to the 64-byte
+    // blocks stage 1 works in.
+    for (std::size_t k = 0; k < 130; ++k) {
+        const std::string run(k, 'a');
+        const custom_json::Value value = custom_json::parse(pad + "[\"" + run + R"(\\\\\\\" \\", "b\\\\", "c"])");
+        REQUIRE(value.as_array().size() == 3);
+        REQUIRE(value.as_array()[0].as_string() == run + R"(\\\" \)");
+        REQUIRE(value.as_array()[1].as_string() == R"(b\\)");
+        REQUIRE(value.as_array()[2].as_string() == "c");
+    }
+
+    // Scalars and strings run into garbage, unterminated strings at the end
+    // of the input, and the other grammar errors are found at the same byte.
+    using custom_json::ParseErrorCode;
+    const struct {
+        const char* json;
+        ParseErrorCode code;
+    } cases[] = {
+        {"[truex]", ParseErrorCode::UnrecognizedValue},
+        {"[12abc]", ParseErrorCode::InvalidNumber},
+        {"[\"a\"x]", ParseErrorCode::ExpectedArrayEnd},
+        {"[1, nul", ParseErrorCode::UnrecognizedValue},
+        {"[\"abc", ParseErrorCode::UnterminatedString},
+        {"[\"abc\\\"", ParseErrorCode::UnterminatedString},
+        {"[\"a\\qb\"]", ParseErrorCode::InvalidEscape},
+        {"[1 2]", ParseErrorCode::ExpectedArrayEnd},
+        {"{\"a\" 1}", ParseErrorCode::ExpectedColon},
+        {"{\"a\": 1", ParseErrorCode::ExpectedObjectEnd},
+        {"[1] x", ParseErrorCode::TrailingCharacters},
+    };
+    for (const auto& c : cases) {
+        const auto bytes = custom_json::try_parse(c.json);
+        const auto indexed = custom_json::try_parse(pad + c.json);
+        REQUIRE_FALSE(bytes.has_value());
+        REQUIRE_FALSE(indexed.has_value());
+        REQUIRE(bytes.error().code == c.code);
+        REQUIRE(indexed.error().code == c.code);
+        REQUIRE(indexed.error().offset == pad.size() + bytes.error().offset);
+    }
+}
+
+// Every vector variant must stop at the same byte as the scalar reference,
+// whatever the alignment and length of the whitespace run.
+TEST_CASE("Whitespace kernels agree with the scalar reference") {
+    using namespace custom_json::kernels;
+    std::vector<SkipWhitespaceFn> variants{skip_whitespace_sse2};
+    if (custom_json::detected_simd_level() >= custom_json::SimdLevel::AVX2) variants.push_back(json_skip_whitespace_avx2);
+    if (custom_json::detected_simd_level() >= custom_json::SimdLevel::AVX512) variants.push_back(skip_whitespace_avx512);
+
+    const std::string pattern = " \t\r\n";
+    for (std::size_t run = 0; run < 150; ++run) {
+        for (std::size_t offset = 0; offset < 4; ++offset) {
+            std::string input(offset, 'x');  // shifts the alignment of the run
+            for (std::size_t i = 0; i < run; ++i) input += pattern[i % pattern.size()];
+            input += "\v{";  // vertical tab is not JSON whitespace
+
+            const char* begin = input.data() + offset;
+            const char* full = input.data() + input.size();
+            for (const char* end : {begin + run, full}) {
+                const char* expected = skip_whitespace_scalar(begin, end);
+                REQUIRE(expected == begin + run);
+                for (SkipWhitespaceFn fn : variants) {
+                    REQUIRE(fn(begin, end) == expected);
+                }
+            }
+        }
+    }
+}
+
+// Backslash runs of every length, straddling the 64-byte block boundary,
+// must resolve to the same closing quote in every variant.
+TEST_CASE("String scanning kernels agree with the scalar reference") {
+    using namespace custom_json::kernels;
+    std::vector<FindStringEndFn> variants{find_string_end_sse2};
+    if (custom_json::detected_simd_level() >= custom_json::SimdLevel::AVX2) variants.push_back(find_string_end_avx2);
+    if (custom_json::detected_simd_level() >= custom_json::SimdLevel::AVX512) variants.push_back(find_string_end_avx512);
+
+    for (std::size_t prefix = 0; prefix < 140; prefix += 7) {
+        for (std::size_t backslashes = 0; backslashes < 6; ++backslashes) {
+            for (const char* rest : {"\"tail\"", "x\"", "\n\"", ""}) {
+                const std::string input = std::string(prefix, 'a') + std::string(backslashes, '\\') + rest;
+                const char* begin = input.data();
+                const char* end = input.data() + input.size();
+                const char* expected = find_string_end_scalar(begin, end);
+                for (FindStringEndFn fn : variants) {
+                    REQUIRE(fn(begin, end) == expected);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Quote-or-backslash kernels agree with the scalar reference") {
+    using namespace custom_json::kernels;
+    std::vector<FindQuoteOrBackslashFn> variants{find_quote_or_backslash_sse2};
+    if (custom_json::detected_simd_level() >= custom_json::SimdLevel::AVX2) variants.push_back(json_find_quote_or_backslash_avx2);
+
+    for (std::size_t prefix = 0; prefix < 100; ++prefix) {
+        for (const char* rest : {"\"", "\\", "\x01", "\x7f\xff\"", ""}) {
+            const std::string input = std::string(prefix, 'a') + rest;
+            const char* begin = input.data();
+            const char* end = input.data() + input.size();
+            const char* expected = find_quote_or_backslash_scalar(begin, end);
+            for (FindQuoteOrBackslashFn fn : variants) {
+                REQUIRE(fn(begin, end) == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("Literal and key comparison kernels agree with the scalar reference") {
+    using namespace custom_json::kernels;
+    for (const std::string text : {"true", "false", "null", "fals", "nul", "truE", "falsey", "nulll", "t", "", "xtrue"}) {
+        for (std::size_t length = 0; length <= text.size(); ++length) {
+            const char* end = text.data() + length;
+            REQUIRE(match_literal(text.data(), end) == match_literal_scalar(text.data(), end));
+        }
+    }
+
+    const std::string key(70, 'k');
+    for (std::size_t length = 0; length <= key.size(); ++length) {
+        for (std::size_t diff = 0; diff <= length; ++diff) {
+            std::string other = key.substr(0, length);
+            if (diff < length) other[diff] = static_cast<char>(diff % 2 ? 'a' : 'z');
+            const int expected = memcmp_bounded_scalar(key.data(), other.data(), length);
+            const int actual = memcmp_bounded(key.data(), other.data(), length);
+            REQUIRE((actual < 0) == (expected < 0));
+            REQUIRE((actual > 0) == (expected > 0));
+        }
+    }
+}
+
+TEST_CASE("A string ending in an escaped backslash is terminated") {
+    const custom_json::Value value = custom_json::parse(R"(["a\\", "b"])");
+    REQUIRE(value.as_array().size() == 2);
+    REQUIRE_THROWS(custom_json::parse("\"a\\\""));
+    REQUIRE_THROWS(custom_json::parse("\"tab\tinside\""));
+}
+
+TEST_CASE("Escape sequences are decoded") {
+    using custom_json::parse;
+    REQUIRE(parse(R"("a\"b\\c\/d")").as_string() == "a\"b\\c/d");
+    REQUIRE(parse(R"("\b\f\n\r\t")").as_string() == "\b\f\n\r\t");
+    REQUIRE(parse(R"("\u0041\u00e9\u4E2D")").as_string() == "A\xC3\xA9\xE4\xB8\xAD");
+    REQUIRE(parse(R"("\ud83d\ude00")").as_string() == "\xF0\x9F\x98\x80");
+    REQUIRE(parse(R"("\u0000")").as_string() == std::string(1, '\0'));
+
+    // Long unescaped runs around an escape take the vector copy path.
+    const std::string run(100, 'x');
+    REQUIRE(parse("\"" + run + "\\n" + run + "\"").as_string() == run + "\n" + run);
+
+    REQUIRE_THROWS(parse(R"("\x")"));
+    REQUIRE_THROWS(parse(R"("\u00")"));
+    REQUIRE_THROWS(parse(R"("\ud83d")"));
+    REQUIRE_THROWS(parse(R"("\ude00")"));
+    REQUIRE_THROWS(parse(R"("\ud83dA")"));
+}
+
+TEST_CASE("String decoding kernels agree with the scalar reference") {
+    using namespace custom_json::kernels;
+    std::vector<DecodeStringFn> variants{decode_string_sse2};
+    if (custom_json::detected_simd_level() >= custom_json::SimdLevel::AVX2) variants.push_back(decode_string_avx2);
+
+    for (std::size_t prefix = 0; prefix < 80; prefix += 5) {
+        for (const char* escape : {"", "\\n", "\\\\", "\\u00e9", "\\ud83d\\ude00", "\\q", "\\u12"}) {
+            const std::string input = std::string(prefix, 'a') + escape + std::string(prefix % 37, 'b');
+            std::string expected(input.size(), '\0');
+            char* expected_end = decode_string_scalar(input.data(), input.data() + input.size(), expected.data());
+            for (DecodeStringFn fn : variants) {
+                std::string actual(input.size(), '\0');
+                char* actual_end = fn(input.data(), input.data() + input.size(), actual.data());
+                REQUIRE((actual_end == nullptr) == (expected_end == nullptr));
+                if (expected_end) {
+                    REQUIRE(actual.substr(0, actual_end - actual.data()) == expected.substr(0, expected_end - expected.data()));
+                }
+
+                // In place, with a second escape after the output has fallen behind
+                std::string in_place = input + "\\t" + input;
+                std::string reference(in_place.size(), '\0');
+                char* reference_end = decode_string_scalar(in_place.data(), in_place.data() + in_place.size(), reference.data());
+                char* in_place_end = fn(in_place.data(), in_place.data() + in_place.size(), in_place.data());
+                REQUIRE((in_place_end == nullptr) == (reference_end == nullptr));
+                if (reference_end) {
+                    REQUIRE(in_place.substr(0, in_place_end - in_place.data()) == reference.substr(0, reference_end - reference.data()));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Numbers are parsed exactly and strictly") {
+    using custom_json::parse;
+    REQUIRE(parse("38013.8647661329").as_number() == 38013.8647661329);
+    REQUIRE(parse("-0.1").as_number() == -0.1);
+    REQUIRE(parse("1E5").as_number() == 1e5);
+    REQUIRE(parse("2.2250738585072011e-308").as_number() == 2.2250738585072011e-308);
+    REQUIRE(parse("4.9406564584124654e-324").as_number() == 4.9406564584124654e-324);
+    REQUIRE(parse("9007199254740993").as_number() == 9007199254740992.0);  // ties round to even
+    REQUIRE(parse("123456789012345678901234567890").as_number() == 123456789012345678901234567890.0);
+    REQUIRE(parse("0.00000000000000000000000012345678901234567890").as_number() == 1.2345678901234567890e-25);
+
+    for (const char* invalid : {"01", "-", "1.", ".5", "1e", "1e+", "+1", "-01", "1.e5", "1ee5", "0x10"}) {
+        REQUIRE_THROWS(parse(invalid));
+    }
+}
+
+TEST_CASE("Integers are kept exactly") {
+    using custom_json::parse;
+    using Type = custom_json::Value::Type;
+
+    const custom_json::Value employees = parse("868");
+    REQUIRE(employees.type() == Type::Number);
+    REQUIRE(employees.is_integer());
+    REQUIRE(employees.as_int64() == 868);
+    REQUIRE(employees.as_number() == 868.0);
+
+    REQUIRE(parse("9007199254740993").as_int64() == 9007199254740993LL);
+    REQUIRE(parse("-9223372036854775808").as_int64() == INT64_MIN);
+    REQUIRE(parse("18446744073709551615").as_uint64() == UINT64_MAX);
+    REQUIRE_THROWS_AS(parse("18446744073709551615").as_int64(), std::out_of_range);
+    REQUIRE_THROWS_AS(parse("-1").as_uint64(), std::out_of_range);
+
+    REQUIRE_FALSE(parse("18446744073709551616").is_integer());
+    REQUIRE_FALSE(parse("1.0").is_integer());
+    REQUIRE(parse("1.0").as_int64() == 1);
+    REQUIRE_THROWS_AS(parse("1.5").as_int64(), std::out_of_range);
+    REQUIRE(std::signbit(parse("-0").as_number()));
+
+    // A type mismatch is reported as it was by the variant-based get<T>().
+    REQUIRE_THROWS_AS(parse("\"868\"").as_int64(), std::bad_variant_access);
+    REQUIRE_THROWS_AS(parse("868").as_string(), std::bad_variant_access);
+    REQUIRE_THROWS_AS(parse("null").as_bool(), std::bad_variant_access);
+    REQUIRE_THROWS_AS(parse("[1]").as_object(), std::bad_variant_access);
+    REQUIRE_THROWS_AS(parse("{}").as_array(), std::bad_variant_access);
+    REQUIRE_THROWS_AS(parse("true").as_number(), std::bad_variant_access);
+}
+
+// Large enough to go through stage 1, with strings and escapes that cross
+// the 64-byte block boundaries.
+TEST_CASE("Every SIMD level produces the same document") {
+    using custom_json::SimdLevel;
+    using custom_json::kernels::use_simd_level;
+
+    std::string document = "[";
+    for (int i = 0; i < 200; ++i) {
+        document += "{\"name\": \"item_" + std::to_string(i) + std::string(i % 70, 'x') + "\\\\\",  \"escaped\": \"a\\\"b\\u00e9\",\n"
+                    "    \"values\": [1, -2.5e3, true, false, null]},";
+    }
+    document += "{}]";
+
+    const auto flatten = [](const custom_json::Value& v) {
+        std::string out;
+        for (const auto& item : v.as_array()) {
+            for (const auto& [key, value] : item.as_object()) {
+                out += std::string(key) + "=";
+                if (value.type() == custom_json::Value::Type::String) out += value.as_string();
+                if (value.type() == custom_json::Value::Type::Array) out += std::to_string(value.as_array().size());
+                out += ";";
+            }
+        }
+        return out;
+    };
+
+    const SimdLevel detected = custom_json::detected_simd_level();
+    use_simd_level(SimdLevel::Scalar);
+    const std::string expected = flatten(custom_json::parse(document));
+    for (SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > detected) break;
+        REQUIRE(use_simd_level(level) == level);
+        REQUIRE(flatten(custom_json::parse(document)) == expected);
+        REQUIRE_THROWS(custom_json::parse(document.substr(0, document.size() / 2) + "\"unterminated"));
+    }
+    use_simd_level(detected);
+}
+
+TEST_CASE("UTF-8 validation kernels agree with the scalar reference") {
+    using namespace custom_json::kernels;
+    if (custom_json::detected_simd_level() < custom_json::SimdLevel::AVX2) return;
+
+    // Every pairing of these pieces, at offsets either side of the 32- and
+    // 64-byte boundaries, so sequences are split between vector chunks.
+    const std::vector<std::string> pieces{
+        "a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\x80", "\xC0\xAF", "\xC2", "\xE0\x80\xAF",
+        "\xE0\xA0\x80", "\xED\xA0\x80", "\xED\x9F\xBF", "\xF4\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80", "\xFF"};
+    for (std::size_t prefix = 0; prefix < 70; ++prefix) {
+        for (const std::string& first : pieces) {
+            for (const std::string& second : pieces) {
+                const std::string input = std::string(prefix, 'x') + first + second + std::string(prefix % 5, 'y');
+                const char* begin = input.data();
+                REQUIRE(validate_utf8_avx2(begin, begin + input.size()) == validate_utf8_scalar(begin, begin + input.size()));
+            }
+        }
+    }
+    REQUIRE(validate_utf8_scalar("\xF0\x9F\x98\x80", "\xF0\x9F\x98\x80" + 4));
+    REQUIRE_FALSE(validate_utf8_scalar("\xF0\x9F\x98", "\xF0\x9F\x98" + 3));
+}
+
+TEST_CASE("Invalid UTF-8 is rejected only when validation is on") {
+    using custom_json::SimdLevel;
+    using custom_json::kernels::use_simd_level;
+    const custom_json::ParseOptions validate{.validate_utf8 = true};
+
+    const std::string large_prefix = "[" + std::string(5000, ' ') + "\"filler\",";
+    const SimdLevel detected = custom_json::detected_simd_level();
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > detected) break;
+        use_simd_level(level);
+        for (const std::string& prefix : {std::string("["), large_prefix}) {
+            REQUIRE(custom_json::parse(prefix + "\"caf\xC3\xA9 \\n \xF0\x9F\x98\x80\"]", validate).as_array().back().as_string() ==
+                    "caf\xC3\xA9 \n \xF0\x9F\x98\x80");
+            for (const char* bad : {"\xC3", "\xC0\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\x80\\n"}) {
+                const std::string document = prefix + "{\"k\": \"" + bad + "\"}]";
+                REQUIRE_NOTHROW(custom_json::parse(document));
+                REQUIRE_THROWS(custom_json::parse(document, validate));
+                const std::string as_key = prefix + "{\"" + bad + "\": 1}]";
+                REQUIRE_THROWS(custom_json::parse(as_key, validate));
+            }
+        }
+    }
+    use_simd_level(detected);
+}
+
+TEST_CASE("Objects keep source order and replace duplicate keys") {
+    const custom_json::Value small = custom_json::parse(R"({"z": 1, "a": 2, "m": 3, "a": 4})");
+    std::string order;
+    for (const auto& [key, value] : small.as_object()) order += std::string(key) + std::to_string(value.as_int64());
+    REQUIRE(order == "z1a4m3");
+    REQUIRE(small.as_object().size() == 3);
+    REQUIRE_THROWS_AS(small.as_object().at("b"), std::out_of_range);
+
+    // Large enough to be looked up through the hash index
+    std::string json = "{";
+    for (int i = 0; i < 100; ++i) json += "\"key" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+    json += "\"key7\": -7}";
+    custom_json::Value::Object large = custom_json::parse(json).as_object();
+    REQUIRE(large.size() == 100);
+    for (int i = 0; i < 100; ++i) REQUIRE(large.at("key" + std::to_string(i)).as_int64() == (i == 7 ? -7 : i));
+    REQUIRE(large.begin()[7].first == "key7");
+    REQUIRE(large.find("key100") == large.end());
+    large["key100"] = custom_json::Value(true);
+    REQUIRE(large.at("key100").as_bool());
+    REQUIRE((large.end() - 1)->first == "key100");
+
+    // Keys past the inline capacity spill, escaped or not
+    const std::string long_key(40, 'k');
+    const custom_json::Value spilled = custom_json::parse("{\"" + long_key + "\": 1, \"short\\u0021\": 2, \"" +
+                                                          long_key + "\\n\": 3}");
+    REQUIRE(spilled.as_object().at(long_key).as_int64() == 1);
+    REQUIRE(spilled.as_object().at("short!").as_int64() == 2);
+    REQUIRE(spilled.as_object().at(long_key + "\n").as_int64() == 3);
+    custom_json::Value::Object copy = spilled.as_object();
+    REQUIRE(copy.begin()->first == long_key);
+}
+
+TEST_CASE("Malformed input is reported without throwing") {
+    using custom_json::ParseErrorCode;
+    const auto error_of = [](std::string_view json) {
+        const auto result = custom_json::try_parse(json);
+        REQUIRE_FALSE(result.has_value());
+        return result.error();
+    };
+
+    REQUIRE(custom_json::try_parse(R"({"a": [1, 2]})").value().as_object().at("a").as_array().size() == 2);
+
+    const struct {
+        const char* json;
+        ParseErrorCode code;
+        std::size_t offset;
+    } cases[] = {
+        {"", ParseErrorCode::UnexpectedEnd, 0},
+        {"[1, 2", ParseErrorCode::ExpectedArrayEnd, 5},
+        {"[1 2]", ParseErrorCode::ExpectedArrayEnd, 3},
+        {"{\"a\" 1}", ParseErrorCode::ExpectedColon, 5},
+        {"{1: 2}", ParseErrorCode::ExpectedKey, 1},
+        {"{\"a\": 1,}", ParseErrorCode::ExpectedKey, 8},
+        {"{\"a\": 1", ParseErrorCode::ExpectedObjectEnd, 7},
+        {"[tru]", ParseErrorCode::UnrecognizedValue, 1},
+        {"[1.e5]", ParseErrorCode::InvalidNumber, 1},
+        {"[\"abc", ParseErrorCode::UnterminatedString, 1},
+        {"[\"a\\q\"]", ParseErrorCode::InvalidEscape, 1},
+        {"[\"a\tb\"]", ParseErrorCode::ControlCharacterInString, 3},
+        {"[1] x", ParseErrorCode::TrailingCharacters, 4},
+    };
+    for (const auto& c : cases) {
+        const custom_json::ParseError error = error_of(c.json);
+        REQUIRE(error.code == c.code);
+        REQUIRE(error.offset == c.offset);
+    }
+
+    // Large enough for stage 1, which reports its own errors.
+    const std::string large = "[\n" + std::string(5000, ' ') + "1,\n  \"unterminated]";
+    const custom_json::ParseError unterminated = error_of(large);
+    REQUIRE(unterminated.code == ParseErrorCode::UnterminatedString);
+    REQUIRE(unterminated.offset == large.find('"'));
+    REQUIRE(unterminated.location(large).line == 3);
+    REQUIRE(unterminated.location(large).column == 3);
+
+    const std::string bad_utf8 = large.substr(0, large.size() - 1) + "\xC3(\"]";
+    const auto utf8_error = custom_json::try_parse(bad_utf8, {.validate_utf8 = true});
+    REQUIRE(utf8_error.error().code == ParseErrorCode::InvalidUtf8);
+    REQUIRE(utf8_error.error().offset == bad_utf8.find('('));
+
+    REQUIRE_THROWS_WITH(custom_json::parse("{\n  \"a\": tru\n}"), "JSON parse error: Unrecognized JSON value at line 2, column 8");
+}
+
+// True if the element and the tree hold the same values. Objects are
+// compared by lookup, since the tree does not keep member order.
+static bool same_value(const custom_json::Element& element, const custom_json::Value& value) {
+    using Type = custom_json::Value::Type;
+    if (element.type() != value.type()) return false;
+    switch (value.type()) {
+        case Type::Null: return true;
+        case Type::Boolean: return element.as_bool() == value.as_bool();
+        case Type::Number:
+            if (element.is_integer() != value.is_integer()) return false;
+            if (!value.is_integer()) return element.as_number() == value.as_number();
+            return value.as_number() < 0 ? element.as_int64() == value.as_int64() : element.as_uint64() == value.as_uint64();
+        case Type::String: return element.as_string() == value.as_string();
+        case Type::Array: {
+            const auto& arr = value.as_array();
+            if (element.as_array().size() != arr.size()) return false;
+            std::size_t i = 0;
+            for (custom_json::Element item : element.as_array()) {
+                if (!same_value(item, arr[i++])) return false;
+            }
+            return true;
+        }
+        case Type::Object: {
+            const auto& obj = value.as_object();
+            if (element.as_object().size() != obj.size()) return false;
+            for (const custom_json::Member& member : element.as_object()) {
+                auto it = obj.find(std::string(member.key));
+                if (it == obj.end() || !same_value(member.value, it->second)) return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST_CASE("A tape document holds the same values as the tree") {
+    for (const auto& entry : fs::directory_iterator("./test-json")) {
+        std::ifstream file(entry.path());
+        const std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const custom_json::Value tree = custom_json::parse(json);
+        const custom_json::Document doc = custom_json::parse_document(json);
+        REQUIRE(same_value(doc.root(), tree));
+        REQUIRE(same_value(custom_json::Document::from_value(tree).root(), tree));
+        REQUIRE(same_value(doc.root(), doc.root().to_value()));
+    }
+
+    const custom_json::Document doc = custom_json::parse_document(
+        R"({"company": {"name": "Acme \"Rockets\"", "staff": [868, -1, 2.5, 18446744073709551615]}, "open": true, "x": null})");
+    const custom_json::Element root = doc.root();
+    REQUIRE(root["company"]["name"].as_string() == "Acme \"Rockets\"");
+    REQUIRE(root["company"]["staff"].as_array().size() == 4);
+    REQUIRE(root["company"]["staff"][1].as_int64() == -1);
+    REQUIRE(root["company"]["staff"][2].as_number() == 2.5);
+    REQUIRE(root["company"]["staff"][3].as_uint64() == UINT64_MAX);
+    REQUIRE(root["open"].as_bool());
+    REQUIRE(root["x"].is_null());
+    REQUIRE_FALSE(root.find("missing"));
+    REQUIRE_THROWS_AS(root["missing"], std::out_of_range);
+    REQUIRE_THROWS(root["open"].as_string());
+
+    // The tape keeps duplicate keys, but looking one up gives the last
+    // member, as the tree and to_value() do.
+    const std::string duplicates = R"({"a": 1, "b": 2, "a": 3})";
+    const custom_json::Document dup = custom_json::parse_document(duplicates);
+    REQUIRE(dup.root().as_object().size() == 3);
+    REQUIRE(dup.root()["a"].as_int64() == 3);
+    REQUIRE(dup.root()[*dup.key("a")].as_int64() == 3);
+    REQUIRE(dup.root().to_value().as_object().at("a").as_int64() == 3);
+    REQUIRE(custom_json::parse(duplicates).as_object().at("a").as_int64() == 3);
+    REQUIRE(custom_json::try_parse_document("[1, ]").error().code == custom_json::ParseErrorCode::UnrecognizedValue);
+}
+
+TEST_CASE("Document keys are interned") {
+    const std::string json = R"([{"name": "a", "budget": 1}, {"budget": 2, "name": "b"}, {"n\u0061me": "c"}])";
+    for (const custom_json::Document& doc : {custom_json::parse_document(json), custom_json::parse_document_view(json)}) {
+        const custom_json::Element root = doc.root();
+        REQUIRE((*root[0].as_object().begin()).key.data() == (*(++root[1].as_object().begin())).key.data());
+        REQUIRE((*root[2].as_object().begin()).key.data() == (*root[0].as_object().begin()).key.data());
+
+        const std::optional<custom_json::Key> name = doc.key("name");
+        REQUIRE(name);
+        REQUIRE_FALSE(doc.key("missing"));
+        REQUIRE(root[1][*name].as_string() == "b");
+        REQUIRE(root[2][*name].as_string() == "c");
+        REQUIRE(root[0][*doc.key("budget")].as_int64() == 1);
+        REQUIRE_FALSE(root[2].find(*doc.key("budget")));
+        REQUIRE_THROWS_AS(root[0]["budget"].find(*name), std::runtime_error);
+    }
+
+    // Each distinct key is stored once: "name" and "budget" with their
+    // length prefixes and NULs, then the three values.
+    REQUIRE(custom_json::parse_document(json).string_buffer_size() == (4 + 4 + 1) + (4 + 6 + 1) + 3 * (4 + 1 + 1));
+}
+
+TEST_CASE("Keys that differ only in the middle are interned in linear time") {
+    using custom_json::DocumentTestAccess;
+    // Long keys that share a prefix and a suffix, once in order and again
+    // in reverse, so every key is interned once and then found.
+    const auto key_name = [](std::size_t n) { return "settings_" + std::to_string(n) + "_override"; };
+    for (std::size_t count : {1000, 4000}) {
+        std::string json = "[{";
+        for (std::size_t n = 0; n < count; ++n) json += (n ? ",\"" : "\"") + key_name(n) + "\": " + std::to_string(n);
+        json += "}, {";
+        for (std::size_t n = count; n-- > 0;) json += "\"" + key_name(n) + "\": " + std::to_string(n) + (n ? "," : "");
+        json += "}]";
+
+        const custom_json::Document doc = custom_json::parse_document(json);
+        REQUIRE(DocumentTestAccess::key_count(doc) == count);
+        REQUIRE(DocumentTestAccess::key_slots(doc) <= 4 * count);
+        // One probe per member when no two keys collide; a hash that missed
+        // the middle bytes needs about count / 2 per member.
+        REQUIRE(DocumentTestAccess::key_probes(doc) < 2 * (2 * count));
+
+        std::vector<const char*> stored;
+        for (const custom_json::Member& member : doc.root()[0].as_object()) {
+            REQUIRE(member.key == key_name(stored.size()));
+            REQUIRE(member.value.as_int64() == static_cast<int64_t>(stored.size()));
+            stored.push_back(member.key.data());
+        }
+        REQUIRE(stored.size() == count);
+        std::size_t n = count;
+        for (const custom_json::Member& member : doc.root()[1].as_object()) {
+            REQUIRE(member.key.data() == stored[--n]);
+        }
+        for (std::size_t k = 0; k < count; k += 97) {
+            const std::optional<custom_json::Key> key = doc.key(key_name(k));
+            REQUIRE(key);
+            REQUIRE(doc.root()[0][*key].as_int64() == static_cast<int64_t>(k));
+            REQUIRE(doc.root()[1][*key].as_int64() == static_cast<int64_t>(k));
+        }
+        REQUIRE_FALSE(doc.key(key_name(count)));
+    }
+}
+
+TEST_CASE("A document view leaves unescaped strings in the input") {
+    for (const auto& entry : fs::directory_iterator("./test-json")) {
+        std::ifstream file(entry.path());
+        const std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        REQUIRE(same_value(custom_json::parse_document_view(json).root(), custom_json::parse(json)));
+    }
+
+    const std::string json = R"({"route": "/api/v1", "name": "Acme \"Rockets\"", "tags": ["a", "b"]})";
+    const custom_json::Document doc = custom_json::parse_document_view(json);
+    const std::string_view route = doc.root()["route"].as_string();
+    REQUIRE(route == "/api/v1");
+    REQUIRE(route.data() >= json.data());
+    REQUIRE(route.data() < json.data() + json.size());
+    REQUIRE((*doc.root().as_object().begin()).key.data() == json.data() + 2);
+    REQUIRE(doc.root()["name"].as_string() == "Acme \"Rockets\"");
+    REQUIRE(doc.root()["tags"][1].as_string() == "b");
+    REQUIRE(doc.root()["tags"][1].to_value().as_string() == "b");
+    REQUIRE(doc.string_buffer_size() == sizeof(uint32_t) + 14 + 1);  // only the escaped string is copied
+}
+
+TEST_CASE("In-situ parsing decodes strings in the caller's buffer") {
+    for (const auto& entry : fs::directory_iterator("./test-json")) {
+        std::ifstream file(entry.path());
+        const std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::vector<char> buffer(json.begin(), json.end());
+        REQUIRE(same_value(custom_json::parse_insitu(buffer).root(), custom_json::parse(json)));
+    }
+
+    std::string buffer = R"({"plain": "abc", "escaped": "a\"b\u00e9\n", "list": ["x\ty"]})";
+    const custom_json::Document doc = custom_json::parse_insitu(buffer);
+    const std::string_view plain = doc.root()["plain"].as_string();
+    const std::string_view escaped = doc.root()["escaped"].as_string();
+    REQUIRE(plain == "abc");
+    REQUIRE(escaped == "a\"b\xc3\xa9\n");
+    REQUIRE(doc.root()["list"][0].as_string() == "x\ty");
+    REQUIRE(escaped.data() == buffer.data() + buffer.find("a\"b"));
+    REQUIRE(plain.data()[plain.size()] == '\0');
+    REQUIRE(escaped.data()[escaped.size()] == '\0');
+    REQUIRE(doc.string_buffer_size() == 0);
+
+    std::string bad = R"(["a\n", "\x"])";
+    REQUIRE(custom_json::try_parse_insitu(bad).error().code == custom_json::ParseErrorCode::InvalidEscape);
+}
+
+TEST_CASE("An arena document matches the heap tree and copies out of it") {
+    std::string document = "[";
+    for (int i = 0; i < 300; ++i) document += R"({"id": )" + std::to_string(i) + R"(, "tags": ["a", "b\n"], "name": "a name long enough to need the heap"},)";
+    document += "null]";
+
+    custom_json::Value copied;
+    {
+        const custom_json::ArenaDocument doc = custom_json::parse_arena(document);
+        const custom_json::Value tree = custom_json::parse(document);
+        REQUIRE(doc.root().as_array().size() == tree.as_array().size());
+        REQUIRE(doc.root().as_array()[299].as_object().at("id").as_int64() == 299);
+        REQUIRE(doc.root().as_array()[7].as_object().find("tags")->second.as_array()[1].as_string() == "b\n");
+        copied = doc.root().as_array()[42];
+    }
+    REQUIRE(copied.as_object().at("name").as_string() == "a name long enough to need the heap");
+    REQUIRE(custom_json::try_parse_arena("[1,").error().code == custom_json::ParseErrorCode::UnexpectedEnd);
+}
+
+// Counts requests and the blocks outstanding, so a test can check that
+// values give every block back to the resource it came from.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    std::size_t allocations = 0;
+    std::size_t blocks = 0;
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++allocations;
+        ++blocks;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        --blocks;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// One value with each tag, including strings either side of the inline
+// limit. Long strings and generic containers are allocated from `resource`.
+static std::vector<custom_json::Value> one_of_each(std::pmr::memory_resource* resource) {
+    using custom_json::Value;
+    std::vector<Value> values;
+    values.emplace_back();
+    values.emplace_back(true);
+    values.emplace_back(2.5);
+    values.emplace_back(int64_t(-7));
+    values.emplace_back(uint64_t(42));
+    values.emplace_back(std::string_view("fourteen bytes"), resource);
+    values.emplace_back(std::string_view("fifteen bytes!!"), resource);
+    Value::Array array(resource);
+    array.emplace_back(std::string_view("a string long enough for a block"), resource);
+    array.emplace_back(1);
+    values.emplace_back(std::move(array));
+    Value::Object object(resource);
+    object["key"] = Value(std::string_view("a value long enough for a block"), resource);
+    object["n"] = Value(3);
+    values.emplace_back(std::move(object));
+    // Packed arrays come from the parser, on the default resource; the
+    // second has also cached its generic form.
+    const custom_json::ParseOptions pack{.pack_numeric_arrays = true};
+    values.push_back(custom_json::parse("[1.5, 2.5]", pack));
+    values.push_back(custom_json::parse("[1, 2, 3]", pack));
+    REQUIRE(values.back().as_array().size() == 3);
+    return values;
+}
+
+TEST_CASE("Packed values copy, move and free every kind of value") {
+    static_assert(sizeof(custom_json::Value) == 16);
+    for (std::size_t size = 12; size <= 17; ++size) {
+        const std::string s(size, 'x');
+        REQUIRE(custom_json::Value(s).as_string() == s);
+        REQUIRE(custom_json::parse("\"" + s + "\"").as_string() == s);
+        REQUIRE(custom_json::Value(custom_json::Value(s)).as_string() == s);
+    }
+
+    CountingResource resource;
+    {
+        const std::vector<custom_json::Value> originals = one_of_each(&resource);
+        REQUIRE(resource.blocks > 0);
+        const auto same = [](const custom_json::Value& a, const custom_json::Value& b) {
+            return same_value(custom_json::Document::from_value(a).root(), b);
+        };
+
+        for (const custom_json::Value& from : originals) {
+            for (const custom_json::Value& to : originals) {
+                custom_json::Value copied = to;
+                copied = from;
+                REQUIRE(same(from, copied));
+
+                custom_json::Value source = from;
+                custom_json::Value moved = to;
+                moved = std::move(source);
+                REQUIRE(same(from, moved));
+                REQUIRE(source.type() == custom_json::Value::Type::Null);
+            }
+
+            custom_json::Value self = from;
+            const custom_json::Value& alias = self;
+            self = alias;
+            REQUIRE(same(from, self));
+            self = std::move(self);
+            REQUIRE(same(from, self));
+        }
+
+        // Assigning over values from the resource frees their blocks.
+        std::vector<custom_json::Value> replaced = one_of_each(&resource);
+        const std::size_t before = resource.blocks;
+        for (custom_json::Value& value : replaced) value = custom_json::Value(1);
+        REQUIRE(resource.blocks < before);
+    }
+    REQUIRE(resource.blocks == 0);
+}
+
+TEST_CASE("A parser reuses its memory from one document to the next") {
+    // Counts the arena's requests for more memory
+    CountingResource upstream;
+
+    const auto document = [](int seed) {
+        std::string json = "[";
+        for (int i = 0; i < 400; ++i) json += R"({"id": )" + std::to_string(seed + i) + R"(, "key": "a value long enough to spill to the heap"},)";
+        return json + "null]";
+    };
+
+    custom_json::Parser parser(&upstream);
+    for (int round = 0; round < 3; ++round) {
+        const custom_json::Value& root = parser.parse(document(round));
+        REQUIRE(root.as_array().size() == 401);
+        REQUIRE(root.as_array()[399].as_object().at("id").as_int64() == round + 399);
+        REQUIRE(root.as_array()[0].as_object().at("key").as_string() == "a value long enough to spill to the heap");
+    }
+    const std::size_t warmed_up = upstream.allocations;
+    REQUIRE(parser.try_parse("[1, {\"a\": ").error().code == custom_json::ParseErrorCode::UnexpectedEnd);
+    for (int round = 3; round < 10; ++round) {
+        REQUIRE(parser.parse(document(round)).as_array()[0].as_object().at("id").as_int64() == round);
+    }
+    REQUIRE(upstream.allocations == warmed_up);
+    REQUIRE(parser.parse("\"short\"").as_string() == "short");
+}
+
+TEST_CASE("Numeric arrays can be packed") {
+    custom_json::ParseOptions packed;
+    packed.pack_numeric_arrays = true;
+    const std::string json = R"({"coordinates": [[151.2093, -33.8688], [144.9631, -37.8136]], "ids": [3, -1, 4],
+        "mixed": [1, 2.5], "big": [1, 18446744073709551615], "tags": ["a", 1], "empty": [], "nested": [1, [2, 3]]})";
+    const custom_json::Value tree = custom_json::parse(json, packed);
+    const auto& obj = tree.as_object();
+
+    REQUIRE_FALSE(obj.at("coordinates").as_double_span());
+    const auto sydney = obj.at("coordinates").as_array()[0].as_double_span();
+    REQUIRE(sydney);
+    REQUIRE(sydney->size() == 2);
+    REQUIRE((*sydney)[1] == -33.8688);
+    REQUIRE(obj.at("ids").as_int64_span()->back() == 4);
+    REQUIRE_FALSE(obj.at("ids").as_double_span());
+    for (const char* generic : {"mixed", "big", "tags", "empty", "nested"}) {
+        REQUIRE_FALSE(obj.at(generic).as_double_span());
+        REQUIRE_FALSE(obj.at(generic).as_int64_span());
+    }
+    REQUIRE(obj.at("nested").as_array()[1].as_int64_span()->size() == 2);
+    REQUIRE_THROWS_AS(obj.at("ids").as_array()[0].as_int64_span(), custom_json::Value::TypeError);
+
+    // Generic access sees the same values as an unpacked parse
+    REQUIRE(same_value(custom_json::parse_document(json).root(), tree));
+    REQUIRE(obj.at("ids").as_array()[1].as_int64() == -1);
+    REQUIRE(obj.at("ids").as_array()[1].is_integer());
+
+    const custom_json::Value copy = obj.at("ids");
+    REQUIRE(copy.as_int64_span()->size() == 3);
+    REQUIRE(custom_json::Document::from_value(tree).root()["coordinates"][1][0].as_number() == 144.9631);
+    REQUIRE_FALSE(custom_json::parse(json).as_object().at("ids").as_int64_span());
+
+    std::string large = "[";
+    for (int i = 0; i < 1000; ++i) large += std::to_string(i * 0.5) + ",";
+    large += "0.25]";
+    custom_json::Parser parser;
+    REQUIRE_FALSE(parser.try_parse("[[1, 2], [3, ", packed));
+    REQUIRE(parser.parse(large, packed).as_double_span()->size() == 1001);
+    REQUIRE(parser.parse(large, packed).as_array()[999].as_number() == 499.5);
+}
+
+TEST_CASE("A lazy document reads only what is asked for") {
+    const std::string json = R"({"id": 7, "company": {"founded": 1999, "name": "Acme \u0026 Co", "public": true,
+        "staff": [{"name": "Ann"}, {"name": "Bo"}], "ceo": null}, "tags": ["x", "y", "z"],
+        "broken": [1 2 {}], "size": 18446744073709551615, "\u006bey": -2.5})";
+    custom_json::LazyDocument doc(json);
+
+    REQUIRE(doc["company"]["name"].get_string() == "Acme & Co");
+    custom_json::LazyValue company = doc["company"];
+    REQUIRE(company["ceo"].is_null());
+    REQUIRE(company["founded"].get_int64() == 1999);  // wraps around to the start
+    REQUIRE(company["public"].get_bool());
+    REQUIRE(company["staff"][1]["name"].get_string() == "Bo");
+    REQUIRE_FALSE(company.find("missing"));
+    REQUIRE_THROWS_AS(company["missing"], std::out_of_range);
+    REQUIRE_THROWS_AS(company["staff"][2], std::out_of_range);
+
+    // "broken" is skipped by matching brackets, not parsed
+    REQUIRE(doc["size"].get_uint64() == 18446744073709551615u);
+    REQUIRE_THROWS_AS(doc["size"].get_int64(), std::out_of_range);
+    REQUIRE(doc["key"].get_double() == -2.5);
+    REQUIRE(doc["id"].type() == custom_json::Value::Type::Number);
+    REQUIRE_THROWS_AS(doc["id"].get_string(), std::runtime_error);
+    REQUIRE_THROWS_WITH(doc["broken"].to_value(), "JSON parse error: Expected ']' in array at line 3, column 22");
+    REQUIRE(doc["tags"].raw_json() == R"(["x", "y", "z"])");
+
+    std::string seen;
+    for (custom_json::LazyValue tag : doc["tags"].get_array()) seen += tag.get_string();
+    for (const custom_json::LazyMember& member : doc["company"].get_object()) seen += std::string(member.key) + ";";
+    REQUIRE(seen == "xyzfounded;name;public;staff;ceo;");
+
+    custom_json::LazyDocument truncated(R"({"a": {"b": [1, 2)");
+    REQUIRE_THROWS_WITH(truncated["c"], "JSON parse error: Expected ']' in array at line 1, column 18");
+    REQUIRE(truncated["a"].type() == custom_json::Value::Type::Object);
+
+    // What is skipped must still close every bracket with its match, and
+    // what is iterated must not end in a comma; null is checked like a bool.
+    const auto error_of = [](std::string_view text, auto read) -> std::string {
+        custom_json::LazyDocument lazy(text);
+        try {
+            read(lazy);
+        } catch (const std::runtime_error& e) {
+            return e.what();
+        }
+        return "";
+    };
+    const auto skip_first = [](custom_json::LazyDocument& lazy) { (void)lazy["b"]; };
+    REQUIRE(error_of(R"({"a": [1}, "b": 2})", skip_first) == "JSON parse error: Expected ']' in array at line 1, column 9");
+    REQUIRE(error_of(R"({"a": {"x": [}], "b": 2})", skip_first) == "JSON parse error: Expected ']' in array at line 1, column 14");
+    REQUIRE(error_of(R"({"a": [[{}]], "b": 2})", skip_first).empty());
+    REQUIRE(error_of("[1, 2,]", [](custom_json::LazyDocument& lazy) {
+        for (custom_json::LazyValue element : lazy.root().get_array()) (void)element;
+    }) == "JSON parse error: Unrecognized JSON value at line 1, column 7");
+    REQUIRE(error_of(R"({"a": nope})", [](custom_json::LazyDocument& lazy) { (void)lazy["a"].is_null(); }) ==
+            "JSON parse error: Unrecognized JSON value at line 1, column 7");
+    REQUIRE(error_of(R"({"a": nul})", [](custom_json::LazyDocument& lazy) { (void)lazy["a"].is_null(); }) ==
+            "JSON parse error: Unrecognized JSON value at line 1, column 7");
+    const std::string deep = R"({"a": )" + std::string(200, '[') + std::string(200, ']') + R"(, "b": 2})";
+    REQUIRE(error_of(deep, skip_first).empty());
+    const std::string mismatched = R"({"a": )" + std::string(100, '[') + "{" + std::string(100, ']') + "}" + R"(, "b": 2})";
+    REQUIRE_FALSE(error_of(mismatched, skip_first).empty());
+
+    // Every member of every test file reads back as the full parse has it
+    for (const auto& entry : fs::directory_iterator("./test-json")) {
+        if (entry.path().extension() != ".json") continue;
+        std::ifstream file(entry.path());
+        const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const custom_json::Document full = custom_json::parse_document(text);
+        custom_json::LazyDocument lazy(text);
+        if (full.root().type() != custom_json::Value::Type::Object) continue;
+        for (const custom_json::Member& member : full.root().as_object()) {
+            REQUIRE(same_value(member.value, lazy[member.key].to_value()));
+        }
+    }
+}
+
+// Counts each kind of event
+struct CountingHandler {
+    std::size_t scalars = 0, keys = 0, containers = 0, open = 0;
+    void on_null() { ++scalars; }
+    void on_bool(bool) { ++scalars; }
+    void on_number(const custom_json::Number&) { ++scalars; }
+    void on_string(std::string_view) { ++scalars; }
+    void on_key(std::string_view) { ++keys; }
+    void start_array() { ++containers; ++open; }
+    void end_array() { --open; }
+    void start_object() { ++containers; ++open; }
+    void end_object() { --open; }
+};
+
+// Writes the events back out as minified JSON
+struct MinifyingHandler {
+    std::string out;
+    bool first = true;  // no comma before the next value or key
+    bool after_key = false;
+
+    void separate() {
+        if (!first && !after_key) out += ',';
+        first = after_key = false;
+    }
+    void quote(std::string_view s) {
+        out += '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out += escape;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+    void on_null() { separate(); out += "null"; }
+    void on_bool(bool b) { separate(); out += b ? "true" : "false"; }
+    void on_number(const custom_json::Number& n) {
+        separate();
+        char text[32];
+        switch (n.kind) {
+            case custom_json::Number::Kind::Int64: std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(n.i)); break;
+            case custom_json::Number::Kind::UInt64: std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(n.u)); break;
+            case custom_json::Number::Kind::Double: std::snprintf(text, sizeof(text), "%.17g", n.d); break;
+        }
+        out += text;
+    }
+    void on_string(std::string_view s) { separate(); quote(s); }
+    void on_key(std::string_view s) { separate(); quote(s); out += ':'; after_key = true; }
+    void start_array() { separate(); out += '['; first = true; }
+    void end_array() { out += ']'; first = false; }
+    void start_object() { separate(); out += '{'; first = true; }
+    void end_object() { out += '}'; first = false; }
+};
+
+TEST_CASE("SAX handlers see every token without building a tree") {
+    static_assert(custom_json::SaxHandler<CountingHandler>);
+
+    MinifyingHandler minified;
+    REQUIRE(custom_json::parse_sax(R"( {"a\tb": [1, -2.5, "x\u00e9\"", true, null, {}], "c": []} )", minified));
+    REQUIRE(minified.out == "{\"a\\u0009b\":[1,-2.5,\"x\u00e9\\\"\",true,null,{}],\"c\":[]}");
+
+    CountingHandler partial;
+    const auto failed = custom_json::parse_sax("[1, [2, \"\\x\"]]", partial);
+    REQUIRE(failed.error().code == custom_json::ParseErrorCode::InvalidEscape);
+    REQUIRE(partial.scalars == 2);
+
+    for (const auto& entry : fs::directory_iterator("./test-json")) {
+        if (entry.path().extension() != ".json") continue;
+        std::ifstream file(entry.path());
+        const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        CountingHandler counts;
+        REQUIRE(custom_json::parse_sax(text, counts));
+        REQUIRE(counts.open == 0);
+        const custom_json::Document doc = custom_json::parse_document(text);
+        std::size_t keys = 0;
+        const auto count_keys = [&](auto& self, const custom_json::Element& element) -> void {
+            if (element.type() == custom_json::Value::Type::Array) {
+                for (custom_json::Element item : element.as_array()) self(self, item);
+            } else if (element.type() == custom_json::Value::Type::Object) {
+                for (const custom_json::Member& member : element.as_object()) {
+                    ++keys;
+                    self(self, member.value);
+                }
+            }
+        };
+        count_keys(count_keys, doc.root());
+        REQUIRE(counts.keys == keys);
+
+        MinifyingHandler minify;
+        REQUIRE(custom_json::parse_sax(text, minify));
+        REQUIRE(same_value(custom_json::parse_document(minify.out).root(), custom_json::parse(text)));
+    }
+}
+
+// Feeds `json` to a push parser `chunk` bytes at a time.
+template<typename Handler>
+static std::expected<void, custom_json::ParseError> push_parse(std::string_view json, std::size_t chunk, Handler& handler) {
+    custom_json::PushParser<Handler> parser(handler);
+    for (std::size_t at = 0; at < json.size(); at += chunk) {
+        const auto fed = parser.feed(std::span(json.data() + at, std::min(chunk, json.size() - at)));
+        if (!fed) return std::unexpected(fed.error());
+    }
+    return parser.finish();
+}
+
+TEST_CASE("A push parser resumes across chunk boundaries") {
+    // Split at every byte: inside keys, escapes, numbers and literals.
+    const std::string_view json = R"( {"k\"ey": [12.5e3, "a\\éb", true, null, -7, {}], "s": "x"} )";
+    MinifyingHandler whole;
+    REQUIRE(custom_json::parse_sax(json, whole));
+    for (std::size_t split = 0; split <= json.size(); ++split) {
+        MinifyingHandler pushed;
+        custom_json::PushParser<MinifyingHandler> parser(pushed);
+        REQUIRE(parser.feed(json.substr(0, split)));
+        REQUIRE(parser.feed(json.substr(split)).value() == true);
+        REQUIRE(parser.finish());
+        REQUIRE(pushed.out == whole.out);
+    }
+
+    // A handler can pause the parser after each event and act on it before
+    // the rest of the chunk is fed.
+    struct PausingHandler : MinifyingHandler {
+        std::function<void()> pause;
+        void on_number(const custom_json::Number& num) {
+            MinifyingHandler::on_number(num);
+            pause();
+        }
+    };
+    PausingHandler pausing;
+    custom_json::PushParser<PausingHandler> paused(pausing);
+    pausing.pause = [&paused] { paused.pause(); };
+    std::span<const char> rest(json);
+    std::size_t feeds = 0;
+    for (; !rest.empty(); ++feeds) {
+        REQUIRE(paused.feed(rest));
+        rest = rest.last(paused.unread());
+    }
+    REQUIRE(paused.finish());
+    REQUIRE(pausing.out == whole.out);
+    REQUIRE(feeds == 3);
+
+    // A top-level scalar is only complete at the end of the input.
+    custom_json::ValueHandler number;
+    custom_json::PushParser<custom_json::ValueHandler> scalar(number);
+    REQUIRE(scalar.feed(std::string_view("-12")).value() == false);
+    REQUIRE(scalar.feed(std::string_view("34")).value() == false);
+    REQUIRE(scalar.finish());
+    REQUIRE(number.take().as_int64() == -1234);
+
+    for (const auto& entry : fs::directory_iterator("./test-json")) {
+        if (entry.path().extension() != ".json") continue;
+        std::ifstream file(entry.path());
+        const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        for (std::size_t chunk : {1, 7, 4096}) {
+            custom_json::ValueHandler tree;
+            REQUIRE(push_parse(text, chunk, tree));
+            REQUIRE(same_value(custom_json::parse_document(text).root(), tree.take()));
+        }
+    }
+
+    // Errors match try_parse(), wherever the input is cut.
+    for (const char* bad : {"", "[1, 2", "[1 2]", "{\"a\" 1}", "{1: 2}", "{\"a\": 1,}", "{\"a\": 1", "[tru]", "[1.e5]",
+                            "[\"abc", "[\"a\\q\"]", "[\"a\tb\"]", "[1] x", "[\"\xC3(\"]"}) {
+        const custom_json::ParseError expected = custom_json::try_parse(bad, {.validate_utf8 = true}).error();
+        for (std::size_t chunk : {1, 3, 64}) {
+            CountingHandler counts;
+            custom_json::PushParser<CountingHandler> parser(counts, {.validate_utf8 = true});
+            const std::string_view input(bad);
+            std::expected<bool, custom_json::ParseError> fed = false;
+            for (std::size_t at = 0; fed && at < input.size(); at += chunk) fed = parser.feed(input.substr(at, chunk));
+            const custom_json::ParseError error = fed ? parser.finish().error() : fed.error();
+            REQUIRE(error.code == expected.code);
+            REQUIRE(error.offset == expected.offset);
+        }
+    }
+}
+
+TEST_CASE("NDJSON records are parsed in parallel and come out in order") {
+    // Each test file, minified onto one line, several times over, with a
+    // blank line and a CRLF now and then.
+    std::vector<std::string> lines;
+    for (int copy = 0; copy < 4; ++copy) {
+        for (const auto& entry : fs::directory_iterator("./test-json")) {
+            if (entry.path().extension() != ".json") continue;
+            std::ifstream file(entry.path());
+            const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            MinifyingHandler minify;
+            REQUIRE(custom_json::parse_sax(text, minify));
+            lines.push_back(minify.out);
+        }
+    }
+    std::string input;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        input += lines[i] + (i % 5 == 0 ? "\r\n" : "\n");
+        if (i % 7 == 0) input += "  \n";
+    }
+
+    for (std::size_t batch_size : {64, 1000, 1 << 20}) {
+        std::size_t next = 0;
+        const auto parsed = custom_json::try_parse_ndjson(input, [&](custom_json::Value&& record) {
+            REQUIRE(next < lines.size());
+            REQUIRE(same_value(custom_json::parse_document(lines[next++]).root(), record));
+        }, {.threads = 4, .batch_size = batch_size});
+        REQUIRE(parsed);
+        REQUIRE(next == lines.size());
+    }
+    REQUIRE(custom_json::parse_ndjson(input, {.threads = 1}).size() == lines.size());
+
+    // The first malformed record stops the parse, after the ones before it.
+    const std::string bad = input + "{\"a\": tru}\n" + input;
+    std::size_t visited = 0;
+    const auto failed = custom_json::try_parse_ndjson(bad, [&](custom_json::Value&&) { ++visited; }, {.threads = 3, .batch_size = 256});
+    REQUIRE(failed.error().code == custom_json::ParseErrorCode::UnrecognizedValue);
+    REQUIRE(failed.error().offset == input.size() + 6);
+    REQUIRE(visited == lines.size());
+    REQUIRE_THROWS_WITH(custom_json::parse_ndjson("[1]\n[2\n"), "JSON parse error: Expected ']' in array at line 2, column 3");
+
+    // So does an exception from the visitor, without waiting on the workers.
+    REQUIRE_THROWS_AS(custom_json::try_parse_ndjson(input, [](custom_json::Value&&) { throw std::logic_error("stop"); },
+                                                    {.threads = 4, .batch_size = 64}),
+                      std::logic_error);
+}
+
+TEST_CASE("Array elements at a JSON Pointer are streamed one at a time") {
+    std::string json = R"({"meta": {"reviews": [0], "count": 3}, "data": {"a/b": [{"x": 1}, {"reviews~": [)";
+    for (int i = 0; i < 5000; ++i) json += std::string(i ? "," : "") + R"({"id": )" + std::to_string(i) + R"(, "text": "review \")" + std::to_string(i) + R"(\"", "tags": ["a", 2.5, null]})";
+    json += R"(]}]}, "after": [1, 2]})";
+    const custom_json::Document doc = custom_json::parse_document(json);
+    const custom_json::Element expected = doc.root()["data"]["a/b"][1]["reviews~"];
+
+    std::istringstream stream(json);
+    for (auto source : {0, 1}) {
+        std::size_t i = 0;
+        auto elements = source ? custom_json::stream_array(stream, "/data/a~1b/1/reviews~0")
+                                     : custom_json::stream_array(std::string_view(json), "/data/a~1b/1/reviews~0");
+        for (custom_json::Value& element : elements) {
+            REQUIRE(same_value(expected[i++], element));
+        }
+        REQUIRE(i == 5000);
+    }
+
+    std::vector<int64_t> scalars;
+    for (custom_json::Value& element : custom_json::stream_array(std::string_view("[1, [2], 3]"), "")) {
+        scalars.push_back(element.type() == custom_json::Value::Type::Array ? -1 : element.as_int64());
+    }
+    REQUIRE(scalars == std::vector<int64_t>{1, -1, 3});
+
+    // Each element is yielded before the next is parsed, so elements ahead
+    // of a malformed one still come out and none after it is built.
+    std::vector<int64_t> before_error;
+    REQUIRE_THROWS_WITH([&] {
+        for (custom_json::Value& element : custom_json::stream_array(std::string_view("[1, 2, 3, x, 4]"), "")) {
+            before_error.push_back(element.as_int64());
+        }
+    }(), "JSON parse error: Unrecognized JSON value at line 1, column 11");
+    REQUIRE(before_error == std::vector<int64_t>{1, 2, 3});
+
+    const auto drain = [](std::string_view text, std::string_view pointer) {
+        for (custom_json::Value& element : custom_json::stream_array(text, pointer)) (void)element;
+    };
+    REQUIRE_THROWS_AS(drain(json, "/data/missing"), std::out_of_range);
+    REQUIRE_THROWS_AS(drain(json, "/data/a~1b/5"), std::out_of_range);
+    REQUIRE_THROWS_WITH(drain(json, "/meta/count"), "Value is not an array");
+    REQUIRE_THROWS_WITH(drain("{\"a\": [1,\n 2, tru]}", "/a"), "JSON parse error: Unrecognized JSON value at line 2, column 5");
+    REQUIRE_THROWS_AS(custom_json::stream_array(std::string_view(json), "data"), std::invalid_argument);
+    REQUIRE_THROWS_AS(custom_json::stream_array(std::string_view(json), "/a~2"), std::invalid_argument);
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+namespace custom_json {
+
+// UTF-8 validators that are fed the input a block at a time and carry
+// partially read sequences from one block to the next. Stage 1 runs one over
+// every 64-byte block it classifies; the validate_utf8 kernels run one over
+// string contents. Call valid() once the last block has been checked.
+
+// Byte-at-a-time checker for the scalar and SSE2 tiers, following the table
+// of well-formed byte sequences in the Unicode standard (Table 3-7).
+// Runs of ASCII are skipped eight bytes at a time.
+struct Utf8ScalarChecker {
+    uint8_t pending = 0;  // continuation bytes still expected
+    uint8_t low = 0x80;   // allowed range of the next continuation byte
+    uint8_t high = 0xBF;
+    bool error = false;
+
+    void check(const char* p, std::size_t n) {
+        std::size_t i = 0;
+        while (i < n) {
+            if (pending == 0 && n - i >= 8) {
+                uint64_t word;
+                std::memcpy(&word, p + i, 8);
+                if ((word & 0x8080808080808080ULL) == 0) {
+                    i += 8;
+                    continue;
+                }
+            }
+            step(static_cast<uint8_t>(p[i++]));
+        }
+    }
+
+    void check_block(const char* block) { check(block, 64); }
+
+    bool valid() const { return !error && pending == 0; }
+
+private:
+    void step(uint8_t c) {
+        if (pending) {
+            error |= c < low || c > high;
+            low = 0x80;
+            high = 0xBF;
+            --pending;
+        } else if (c >= 0x80) {
+            if (c < 0xC2 || c > 0xF4) {
+                error = true;  // continuation without a lead, overlong 2-byte, or beyond U+10FFFF
+            } else if (c < 0xE0) {
+                pending = 1;
+            } else if (c < 0xF0) {
+                pending = 2;
+                if (c == 0xE0) low = 0xA0;   // overlong
+                if (c == 0xED) high = 0x9F;  // surrogates
+            } else {
+                pending = 3;
+                if (c == 0xF0) low = 0x90;   // overlong
+                if (c == 0xF4) high = 0x8F;  // beyond U+10FFFF
+            }
+        }
+    }
+};
+
+// Offset of the byte at which [p, p + n) stops being valid UTF-8, or n if a
+// sequence is cut short by the end. For error reporting, after a block
+// checker has found a problem.
+inline std::size_t utf8_error_offset(const char* p, std::size_t n) {
+    Utf8ScalarChecker checker;
+    for (std::size_t i = 0; i < n; ++i) {
+        checker.check(p + i, 1);
+        if (checker.error) return i;
+    }
+    return n;
+}
+
+// The lookup algorithm of Keiser and Lemire ("Validating UTF-8 in less than
+// one instruction per byte"). Three 16-entry tables, indexed by the high
+// nibble of each byte and both nibbles of the byte before it, flag every
+// invalid two-byte pair; a saturating subtract finds the bytes that must be
+// the third or fourth of a sequence. Blocks of pure ASCII only check that
+// no sequence was left unfinished.
+struct Utf8Avx2Checker {
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+
+    __attribute__((target("avx2")))
+    Utf8Avx2Checker()
+        : error(_mm256_setzero_si256()), prev_input(_mm256_setzero_si256()), prev_incomplete(_mm256_setzero_si256()) {}
+
+    __attribute__((target("avx2")))
+    void check_block(const char* block) {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi)) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            return;
+        }
+        check_chunk(lo, prev_input);
+        check_chunk(hi, lo);
+        prev_incomplete = is_incomplete(hi);
+        prev_input = hi;
+    }
+
+    // Checks 32 bytes; used for the tail of the validate_utf8 kernel.
+    __attribute__((target("avx2")))
+    void check_half(const char* p) {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            return;
+        }
+        check_chunk(input, prev_input);
+        prev_incomplete = is_incomplete(input);
+        prev_input = input;
+    }
+
+    __attribute__((target("avx2")))
+    bool valid() const {
+        const __m256i any = _mm256_or_si256(error, prev_incomplete);
+        return _mm256_testz_si256(any, any);
+    }
+
+private:
+    // Error bits set by the tables; a pair is invalid when all three agree.
+    static constexpr uint8_t kTooShort = 1 << 0;    // lead followed by ASCII or another lead
+    static constexpr uint8_t kTooLong = 1 << 1;     // ASCII followed by a continuation
+    static constexpr uint8_t kOverlong3 = 1 << 2;   // E0 followed by 80..9F
+    static constexpr uint8_t kTooLarge = 1 << 3;    // F4..FF followed by 90..BF
+    static constexpr uint8_t kSurrogate = 1 << 4;   // ED followed by A0..BF
+    static constexpr uint8_t kOverlong2 = 1 << 5;   // C0 or C1
+    static constexpr uint8_t kTooLarge1000 = 1 << 6;  // F5..FF followed by 80..8F
+    static constexpr uint8_t kOverlong4 = 1 << 6;   // F0 followed by 80..8F
+    static constexpr uint8_t kTwoConts = 1 << 7;    // continuation followed by a continuation
+    static constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+    static constexpr uint8_t kByte1High[16] = {
+        kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+        kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+        kTooShort | kOverlong2,
+        kTooShort,
+        kTooShort | kOverlong3 | kSurrogate,
+        kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+    };
+    static constexpr uint8_t kByte1Low[16] = {
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+        kCarry | kOverlong2,
+        kCarry,
+        kCarry,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+    };
+    static constexpr uint8_t kByte2High[16] = {
+        kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooShort, kTooShort, kTooShort, kTooShort,
+    };
+
+    __attribute__((target("avx2")))
+    static __m256i lookup(const uint8_t (&table)[16], __m256i nibbles) {
+        const __m256i t = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table)));
+        return _mm256_shuffle_epi8(t, nibbles);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i high_nibbles(__m256i v) {
+        return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+    }
+
+    // The input shifted right by N bytes, with the last N bytes of the
+    // previous chunk shifted in.
+    template<int N>
+    __attribute__((target("avx2")))
+    static __m256i prev(__m256i input, __m256i prev_input) {
+        return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+    }
+
+    __attribute__((target("avx2")))
+    void check_chunk(__m256i input, __m256i previous) {
+        const __m256i prev1 = prev<1>(input, previous);
+        const __m256i special = _mm256_and_si256(
+            _mm256_and_si256(lookup(kByte1High, high_nibbles(prev1)),
+                             lookup(kByte1Low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+            lookup(kByte2High, high_nibbles(input)));
+        // Only 111xxxxx two bytes back, or 1111xxxx three back, stay >= 0x80.
+        const __m256i third = _mm256_subs_epu8(prev<2>(input, previous), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        const __m256i fourth = _mm256_subs_epu8(prev<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        const __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must_continue, special));
+    }
+
+    // Non-zero where one of the last three bytes starts a sequence that
+    // needs more bytes than the chunk has left.
+    __attribute__((target("avx2")))
+    static __m256i is_incomplete(__m256i input) {
+        const __m256i max_value = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        return _mm256_subs_epu8(input, max_value);
+    }
+};
+
+} // namespace custom_json